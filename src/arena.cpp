@@ -0,0 +1,18 @@
+#include "arena.h"
+
+Arena::Arena(size_t initialSize):
+	resource(initialSize) {}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+	std::lock_guard lock(this->mutex);
+
+	this->allocatedSize += bytes;
+
+	return this->resource.allocate(bytes, alignment);
+}
+
+size_t Arena::GetAllocatedSize() {
+	std::lock_guard lock(this->mutex);
+
+	return this->allocatedSize;
+}
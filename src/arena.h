@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory_resource>
+#include <mutex>
+
+// Monotonic allocator for everything that lives exactly as long as one BND does
+// Freeing is a no-op, it all goes back at once when the arena is destroyed
+// Locked, so the parallel prewarm can share it
+class Arena : public std::pmr::memory_resource {
+private:
+	std::mutex mutex;
+	std::pmr::monotonic_buffer_resource resource;
+	size_t allocatedSize = 0;
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void*, size_t, size_t) override {}
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+public:
+	explicit Arena(size_t initialSize = 0x10000);
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// Everything handed out so far, freed or not
+	size_t GetAllocatedSize();
+};
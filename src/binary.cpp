@@ -1,15 +1,22 @@
 #include "binary.h"
 
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <limits.h>
+	#include <sys/uio.h>
+	#include <unistd.h>
+#endif
+
+#include <cerrno>
 #include <format>
 #include <fstream>
 
 #include "spdlog/spdlog.h"
 
-inline float BufferView::ReverseEndianess(float value) {
-	return *reinterpret_cast<float *>(ReverseEndianess(*reinterpret_cast<uint32_t *>(&value)));
-}
-
-const std::string BufferView::ReadASCII(int length) {
+template<Endian Order>
+const std::string BasicBufferView<Order>::ReadASCII(int length) {
 	if (current + length > end) {
 		throw std::out_of_range(
 			std::format("Buffer overflow at ReadASCII offset= {} length= {}", this->current - this->start, length)
@@ -23,92 +30,74 @@ const std::string BufferView::ReadASCII(int length) {
 	return result;
 }
 
-byte BufferView::ReadByte() {
-	const std::array<byte, sizeof(byte)> byteContainer = Read<sizeof(byte)>();
+template<Endian Order>
+UTF16::ScanResult BasicBufferView<Order>::ScanUTF16() {
+	UTF16::ScanResult scan = UTF16::Scan(this->current, this->end);
 
-	return byteContainer[0];
-}
+	if (!scan.terminated) {
+		throw std::out_of_range(
+			std::format("Buffer overflow at ReadUTF16 offset= {} final string length= {}", this->current - this->start, scan.units)
+		);
+	}
 
-bool BufferView::ReadBoolean() {
-	return ReadByte() == 1;
+	return scan;
 }
 
-int BufferView::ReadInt32() {
-	const std::array<byte, sizeof(int)> intContainer = Read<sizeof(int)>();
+template<Endian Order>
+void BasicBufferView<Order>::ReadScannedUTF16(const UTF16::ScanResult& scan, char* out) {
+	UTF16::Narrow(this->current, scan, out);
+
+	this->current += (scan.units + 1) * 2;
+}
 
-	int result = 0;
+template<Endian Order>
+const std::string BasicBufferView<Order>::ReadUTF16() {
+	UTF16::ScanResult scan = this->ScanUTF16();
 
-	unsigned int b0 = intContainer[0];
-	unsigned int b1 = intContainer[1];
-	unsigned int b2 = intContainer[2];
-	unsigned int b3 = intContainer[3];
+	std::string result(UTF16::GetNarrowLength(this->current, scan), '\0');
 
-	if (bigEndian) {
-		result = (b0 << 24) | (b1 << 16) | (b2 << 8) | b3;
-	}
-	else {
-		result = (b3 << 24) | (b2 << 16) | (b1 << 8) | b0;
-	}
+	this->ReadScannedUTF16(scan, result.data());
 
 	return result;
 }
 
-uint64_t BufferView::ReadInt64() {
-	const std::array<byte, sizeof(uint64_t)> intContainer = Read<sizeof(uint64_t)>();
+template<Endian Order>
+std::pmr::string BasicBufferView<Order>::ReadUTF16(std::pmr::memory_resource* memory) {
+	// Measured first, so the string is allocated exactly once
+	UTF16::ScanResult scan = this->ScanUTF16();
 
-	uint64_t result = 0;
+	std::pmr::string result(UTF16::GetNarrowLength(this->current, scan), '\0', memory);
 
-	uint64_t b0 = intContainer[0];
-	uint64_t b1 = intContainer[1];
-	uint64_t b2 = intContainer[2];
-	uint64_t b3 = intContainer[3];
-	uint64_t b4 = intContainer[4];
-	uint64_t b5 = intContainer[5];
-	uint64_t b6 = intContainer[6];
-	uint64_t b7 = intContainer[7];
-
-	if (bigEndian) {
-		result = (b0 << 56) | (b1 << 48) | (b2 << 40) | (b3 << 32) | (b4 << 24) | (b5 << 16) | (b6 << 8) | b7;
-	}
-	else {
-		result = (b7 << 56) | (b6 << 48) | (b5 << 40) | (b4 << 32) | (b3 << 24) | (b2 << 16) | (b1 << 8) | b0;
-	}
+	this->ReadScannedUTF16(scan, result.data());
 
 	return result;
 }
 
-float BufferView::ReadFloat() {
-	unsigned int container = ReadInt32();
+template<Endian Order>
+std::pmr::string BasicBufferView<Order>::ReadOffsetUTF16(std::pmr::memory_resource* memory) {
+	uint64_t offset = this->ReadInt64();
+	auto currentOffset = this->GetOffset();
 
-	float* floatAddr = reinterpret_cast<float *>(&container);
+	this->SetOffset(offset);
+	std::pmr::string result = this->ReadUTF16(memory);
+	this->SetOffset(currentOffset);
 
-	return *floatAddr;
+	return result;
 }
 
-const std::string BufferView::ReadUTF16() {
-	std::string result;
-	char newChar;
-
-	do {
-		if (this->current >= this->end) {
-			throw std::out_of_range(
-				std::format("Buffer overflow at ReadUTF16 offset= {} final string length= {}", this->current - this->start, result.size())
-			);
-		}
-
-		newChar = *this->current;
-
-		this->current += 2;
-
-		result += newChar;
-	} while (newChar != '\0');
+template<Endian Order>
+std::pmr::string BasicBufferView<Order>::ReadOffsetUTF16(int offset, std::pmr::memory_resource* memory) {
+	auto currentOffset = this->GetOffset();
 
-	result.pop_back();
+	this->SetOffset(offset);
+	std::pmr::string result = this->ReadUTF16(memory);
+	this->SetOffset(currentOffset);
 
 	return result;
 }
 
-const std::string BufferView::ReadOffsetUTF16() {
+template<Endian Order>
+const std::string BasicBufferView<Order>::ReadOffsetUTF16() {
 	uint64_t offset = this->ReadInt64();
 	auto currentOffset = this->GetOffset();
 
@@ -119,7 +108,8 @@ const std::string BufferView::ReadOffsetUTF16() {
 	return result;
 }
 
-const std::string BufferView::ReadOffsetUTF16(int offset) {
+template<Endian Order>
+const std::string BasicBufferView<Order>::ReadOffsetUTF16(int offset) {
 	auto currentOffset = this->GetOffset();
 
 	this->SetOffset(offset);
@@ -129,55 +119,64 @@ const std::string BufferView::ReadOffsetUTF16(int offset) {
 	return result;
 }
 
-void BufferView::AssertByte(byte expected, const std::string& message) {
+template<Endian Order>
+void BasicBufferView<Order>::AssertByte(byte expected, const std::string& message) {
 	if (ReadByte() != expected) {
 		throw std::runtime_error(message);
 	}
 }
 
-void BufferView::AssertByte(byte expected) {
+template<Endian Order>
+void BasicBufferView<Order>::AssertByte(byte expected) {
 	if (ReadByte() != expected) {
 		throw std::runtime_error(std::format("Assertion error at offset: {}", this->GetOffset()));
 	}
 }
 
-void BufferView::AssertInt32(int expected, const std::string& message) {
+template<Endian Order>
+void BasicBufferView<Order>::AssertInt32(int expected, const std::string& message) {
 	if (ReadInt32() != expected) {
 		throw std::runtime_error(message);
 	}
 }
 
-void BufferView::AssertInt32(int expected) {
+template<Endian Order>
+void BasicBufferView<Order>::AssertInt32(int expected) {
 	if (ReadInt32() != expected) {
 		throw std::runtime_error(std::format("Assertion error at offset: {}", this->GetOffset()));
 	}
 }
 
-void BufferView::AssertInt64(uint64_t expected, const std::string& message) {
+template<Endian Order>
+void BasicBufferView<Order>::AssertInt64(uint64_t expected, const std::string& message) {
 	if (ReadInt64() != expected) {
 		throw std::runtime_error(message);
 	}
 }
 
-void BufferView::AssertInt64(uint64_t expected) {
+template<Endian Order>
+void BasicBufferView<Order>::AssertInt64(uint64_t expected) {
 	if (ReadInt64() != expected) {
 		throw std::runtime_error(std::format("Assertion error at offset: {}", this->GetOffset()));
 	}
 }
 
-void BufferView::AssertASCII(const std::string& expected, const std::string& message) {
+template<Endian Order>
+void BasicBufferView<Order>::AssertASCII(const std::string& expected, const std::string& message) {
 	if (ReadASCII(expected.length()) != expected) {
 		throw std::runtime_error(message);
 	}
 }
 
-void BufferView::AssertASCII(const std::string& expected) {
+template<Endian Order>
+void BasicBufferView<Order>::AssertASCII(const std::string& expected) {
 	if (ReadASCII(expected.length()) != expected) {
 		throw std::runtime_error(std::format("Assertion error at offset: {}", this->GetOffset()));
 	}
 }
 
-void BufferView::AssertASCII(const std::string& expected, int explicitLength, const std::string& message) {
+template<Endian Order>
+void BasicBufferView<Order>::AssertASCII(const std::string& expected, int explicitLength, const std::string& message) {
 	auto s = ReadASCII(explicitLength);
 
 	if (expected.length() < explicitLength) {
@@ -198,7 +197,8 @@ void BufferView::AssertASCII(const std::string& expected, int explicitLength, co
 	}
 }
 
-void BufferView::AssertASCII(const std::string& expected, int explicitLength) {
+template<Endian Order>
+void BasicBufferView<Order>::AssertASCII(const std::string& expected, int explicitLength) {
 	auto s = ReadASCII(explicitLength);
 
 	if (expected.length() < explicitLength) {
@@ -219,7 +219,8 @@ void BufferView::AssertASCII(const std::string& expected, int explicitLength) {
 	}
 }
 
-void BufferView::SetPos(byte* pos) {
+template<Endian Order>
+void BasicBufferView<Order>::SetPos(byte* pos) {
 	if (pos >= this->start && pos < this->end) {
 		this->current = pos;
 	}
@@ -230,67 +231,13 @@ void BufferView::SetPos(byte* pos) {
 	}
 }
 
-void BufferView::Advance(int movement) {
+template<Endian Order>
+void BasicBufferView<Order>::Advance(int movement) {
 	SetOffset(this->GetOffset() + movement);
 }
 
-void BufferView::WriteInt32(int value) {
-	if (current + sizeof(int) > end) {
-		throw std::out_of_range(
-			std::format("Buffer overflow at Read offset= {} length= {}", this->current - this->start, sizeof(int))
-		);
-	}
-
-	if (bigEndian) {
-		value = ReverseEndianess(value);
-	}
-
-	memcpy(current, (byte *) &value, sizeof(int));
-
-	current += sizeof(int);
-}
-
-void BufferView::WriteByte(byte value) {
-	Write<1>({value});
-}
-
-void BufferView::WriteBool(bool value) {
-	Write<1>({value});
-}
-
-void BufferView::WriteFloat(float value) {
-	if (current + sizeof(float) > end) {
-		throw std::out_of_range(
-			std::format("Buffer overflow at Read offset= {} length= {}", this->current - this->start, sizeof(float))
-		);
-	}
-
-	if (bigEndian) {
-		value = ReverseEndianess(value);
-	}
-
-	memcpy(current, (byte *) &value, sizeof(float));
-
-	current += sizeof(int);
-}
-
-void BufferView::WriteInt64(uint64_t value) {
-	if (current + sizeof(uint64_t) > end) {
-		throw std::out_of_range(
-			std::format("Buffer overflow at Read offset= {} length= {}", this->current - this->start, sizeof(uint64_t))
-		);
-	}
-
-	if (bigEndian) {
-		value = ReverseEndianess(value);
-	}
-
-	memcpy(current, (byte *) &value, sizeof(uint64_t));
-
-	current += sizeof(uint64_t);
-}
-
-void BufferView::WriteASCII(const std::string& value, bool nullTerminate) {
+template<Endian Order>
+void BasicBufferView<Order>::WriteASCII(const std::string& value, bool nullTerminate) {
 	for (char c : value) {
 		*this->current = c;
 
@@ -304,21 +251,23 @@ void BufferView::WriteASCII(const std::string& value, bool nullTerminate) {
 	}
 }
 
-void BufferView::WriteUTF16(const std::string& s) {
-	for (char c : s) {
-		*this->current = c;
-		*(this->current + 1) = '\0';
+template<Endian Order>
+void BasicBufferView<Order>::WriteUTF16(std::string_view s) {
+	size_t size = UTF16::GetEncodedSize(s);
 
-		this->Advance(2);
+	if (current + size > end) {
+		throw std::out_of_range(
+			std::format("Buffer overflow at WriteUTF16 offset= {} length= {}", this->current - this->start, size)
+		);
 	}
 
-	*this->current = '\0';
-	*(this->current + 1) = '\0';
+	UTF16::Widen(s, this->current);
 
-	this->Advance(2);
+	this->Advance(size);
 }
 
-void BufferView::SetOffset(size_t offset) {
+template<Endian Order>
+void BasicBufferView<Order>::SetOffset(size_t offset) {
 	if (this->start + offset <= this->end) {
 		this->current = const_cast<byte *>(this->start + offset);
 	}
@@ -329,30 +278,25 @@ void BufferView::SetOffset(size_t offset) {
 	}
 }
 
-byte* BufferView::GetPos() {
+template<Endian Order>
+byte* BasicBufferView<Order>::GetPos() {
 	return this->current;
 }
 
-size_t BufferView::GetOffset() {
+template<Endian Order>
+size_t BasicBufferView<Order>::GetOffset() {
 	return this->current - this->start;
 }
 
-bool BufferView::IsBigEndian() {
-	return this->bigEndian;
-}
-
-void BufferView::SetBigEndian(bool setBigEndian) {
-	this->bigEndian = setBigEndian;
-}
+template class BasicBufferView<Endian::Little>;
+template class BasicBufferView<Endian::Big>;
 
 void WriteUTF16ToStream(std::ostream& o, const std::string& s) {
-	for (char c : s) {
-		if (c) {
-			o << c << '\0';
-		}
-	}
+	std::vector<byte> encoded(UTF16::GetEncodedSize(s));
+
+	UTF16::Widen(s, encoded.data());
 
-	o << '\0' << '\0';
+	o.write((const char *) encoded.data(), encoded.size());
 }
 
 void DumpToFile(const std::filesystem::path& p, const byte* start, const byte* end) {
@@ -365,4 +309,97 @@ void DumpToFile(const std::filesystem::path& p, const byte* start, const byte* e
 	output.write((char *) start, end - start);
 
 	output.close();
-}
\ No newline at end of file
+}
+
+#ifdef _WIN32
+bool DumpToFile(const std::filesystem::path& p, const std::vector<std::span<const byte>>& pieces) {
+	HANDLE file = CreateFileW(p.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE) {
+		spdlog::error("Cannot create file: {}, error {}", p.string(), GetLastError());
+
+		return false;
+	}
+
+	bool success = true;
+
+	// WriteFileGather wants page sized and aligned pieces, so this is one call per piece instead
+	for (const auto& piece : pieces) {
+		size_t written = 0;
+
+		while (success && written < piece.size()) {
+			DWORD toWrite = (DWORD) std::min<size_t>(piece.size() - written, 0x40000000);
+			DWORD result = 0;
+
+			success = WriteFile(file, piece.data() + written, toWrite, &result, nullptr);
+			written += result;
+		}
+	}
+
+	if (!success) {
+		spdlog::error("Cannot write file: {}, error {}", p.string(), GetLastError());
+	}
+
+	CloseHandle(file);
+
+	return success;
+}
+#else
+bool DumpToFile(const std::filesystem::path& p, const std::vector<std::span<const byte>>& pieces) {
+	int file = open(p.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (file < 0) {
+		spdlog::error("Cannot create file: {}, error {}", p.string(), errno);
+
+		return false;
+	}
+
+	std::vector<iovec> batch;
+	batch.reserve(std::min<size_t>(pieces.size(), IOV_MAX));
+
+	size_t nextPiece = 0;
+	// How much of the piece at nextPiece already made it to the file
+	size_t pieceWritten = 0;
+	bool success = true;
+
+	while (success && nextPiece < pieces.size()) {
+		batch.clear();
+
+		for (size_t i = nextPiece; i < pieces.size() && batch.size() < IOV_MAX; i++) {
+			size_t skipped = i == nextPiece ? pieceWritten : 0;
+
+			batch.push_back(iovec{ (void *) (pieces[i].data() + skipped), pieces[i].size() - skipped });
+		}
+
+		ssize_t result = writev(file, batch.data(), batch.size());
+
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			spdlog::error("Cannot write file: {}, error {}", p.string(), errno);
+
+			success = false;
+
+			break;
+		}
+
+		// A short write leaves us somewhere in the middle of a piece
+		size_t remaining = result + pieceWritten;
+
+		while (nextPiece < pieces.size() && remaining >= pieces[nextPiece].size()) {
+			remaining -= pieces[nextPiece].size();
+			nextPiece++;
+		}
+
+		pieceWritten = remaining;
+	}
+
+	if (close(file) != 0) {
+		success = false;
+	}
+
+	return success;
+}
+#endif
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <array>
+#include <bit>
 #include <string>
+#include <string_view>
+#include <memory_resource>
 #include <iostream>
 #include <cstring>
 #include <format>
@@ -9,29 +12,90 @@
 #include <filesystem>
 #include <concepts>
 #include <algorithm>
+#include <span>
+#include <vector>
 
-typedef unsigned char byte;
+#include "utf16.h"
 
-class BufferView {
+enum class Endian {
+	Little,
+	Big
+};
+
+// The scalar reads and writes copy straight from memory, the byte order only decides whether they get swapped
+static_assert(std::endian::native == std::endian::little, "Only little endian hosts are supported");
+
+// The byte order is fixed at compile time, so the reads and writes don't branch on it
+// Formats that only say which one they use partway through the header pick it there, see As
+template<Endian Order>
+class BasicBufferView {
 private:
 	const byte* start;
 	const byte* end;
 	byte* current;
 
-	bool bigEndian;
+	// Throws if the string at current isn't terminated before the end
+	UTF16::ScanResult ScanUTF16();
+	// Narrows the scanned string into out and moves past its terminator
+	void ReadScannedUTF16(const UTF16::ScanResult& scan, char* out);
+
+	template<std::integral T>
+	T ReadScalar() {
+		if (current + sizeof(T) > end) {
+			throw std::out_of_range(
+				std::format("Buffer overflow at Read offset= {} length= {}", this->current - this->start, sizeof(T))
+			);
+		}
+
+		T value;
+
+		memcpy(&value, current, sizeof(T));
+
+		current += sizeof(T);
+
+		if constexpr (Order == Endian::Big) {
+			value = ReverseEndianess(value);
+		}
+
+		return value;
+	}
+
+	template<std::integral T>
+	void WriteScalar(T value) {
+		if (current + sizeof(T) > end) {
+			throw std::out_of_range(
+				std::format("Buffer overflow at Write offset= {} length= {}", this->current - this->start, sizeof(T))
+			);
+		}
+
+		if constexpr (Order == Endian::Big) {
+			value = ReverseEndianess(value);
+		}
+
+		memcpy(current, &value, sizeof(T));
+
+		current += sizeof(T);
+	}
 public:
-	BufferView(const byte* start, const byte* end, bool bigEndian = true):
+	BasicBufferView(const byte* start, const byte* end):
 	start(start),
 	end(end),
-	current(const_cast<byte *>(start)),
-	bigEndian(bigEndian) {}
+	current(const_cast<byte *>(start)) {}
 
-	BufferView(const byte* start, size_t length, bool bigEndian = true):
+	BasicBufferView(const byte* start, size_t length):
 	start(start),
 	end(start + length),
-	current(const_cast<byte *>(start)),
-	bigEndian(bigEndian) {}
+	current(const_cast<byte *>(start)) {}
+
+	// The same data and position read with another byte order
+	template<Endian OtherOrder>
+	BasicBufferView<OtherOrder> As() const {
+		BasicBufferView<OtherOrder> result(this->start, this->end);
 
+		result.SetOffset(this->current - this->start);
+
+		return result;
+	}
 
 	template<typename T>
 	requires std::integral<T>
@@ -51,8 +115,6 @@ public:
 		return result;
 	}
 
-	static inline float ReverseEndianess(float value);
-
 	template <size_t Size>
 	const std::array<byte, Size> Read() {
 		if (current + Size > end) {
@@ -72,15 +134,15 @@ public:
 
 	const std::string ReadASCII(int length);
 
-	byte ReadByte();
+	byte ReadByte() { return ReadScalar<byte>(); }
 
-	bool ReadBoolean();
+	bool ReadBoolean() { return ReadByte() == 1; }
 
-	int ReadInt32();
+	int ReadInt32() { return ReadScalar<int>(); }
 
-	uint64_t ReadInt64();
+	uint64_t ReadInt64() { return ReadScalar<uint64_t>(); }
 
-	float ReadFloat();
+	float ReadFloat() { return std::bit_cast<float>(ReadScalar<uint32_t>()); }
 
 	const std::string ReadUTF16();
 
@@ -88,6 +150,35 @@ public:
 
 	const std::string ReadOffsetUTF16(int offset);
 
+	// Same as above, but allocated from memory in one go
+	std::pmr::string ReadUTF16(std::pmr::memory_resource* memory);
+
+	std::pmr::string ReadOffsetUTF16(std::pmr::memory_resource* memory);
+
+	std::pmr::string ReadOffsetUTF16(int offset, std::pmr::memory_resource* memory);
+
+	// Schema is a RecordSchema from record_schema.h
+	template<typename Schema>
+	typename Schema::Struct ReadRecord(const std::string& message) {
+		if (current + Schema::size > end) {
+			throw std::out_of_range(
+				std::format("Buffer overflow at ReadRecord offset= {} length= {}", this->current - this->start, Schema::size)
+			);
+		}
+
+		typename Schema::Struct result{};
+
+		size_t decoded = Schema::template Decode<Order>(current, result);
+
+		if (decoded != Schema::size) {
+			throw std::runtime_error(std::format("{}: unexpected value at offset= {}", message, this->current - this->start + decoded));
+		}
+
+		current += Schema::size;
+
+		return result;
+	}
+
 	template<size_t Length>
 	const std::array<bool, Length> ReadBoolArray() {
 		std::array<bool, Length> result = {false};
@@ -168,19 +259,19 @@ public:
 		current += dataLength;
 	}
 
-	void WriteByte(byte value);
+	void WriteByte(byte value) { WriteScalar<byte>(value); }
 
-	void WriteBool(bool value);
+	void WriteBool(bool value) { WriteScalar<byte>(value); }
 
-	void WriteInt32(int value);
+	void WriteInt32(int value) { WriteScalar<int>(value); }
 
-	void WriteFloat(float value);
+	void WriteFloat(float value) { WriteScalar<uint32_t>(std::bit_cast<uint32_t>(value)); }
 
-	void WriteInt64(uint64_t value);
+	void WriteInt64(uint64_t value) { WriteScalar<uint64_t>(value); }
 
 	void WriteASCII(const std::string& value, bool nullTerminate = true);
 	
-	void WriteUTF16(const std::string& s);
+	void WriteUTF16(std::string_view s);
 
 	byte* GetPos();
 	size_t GetOffset();
@@ -192,19 +283,16 @@ public:
 
 	void SetPos(byte* pos);
 	void SetOffset(size_t offset);
-
-	bool IsBigEndian();
-	void SetBigEndian(bool setBigEndian);
 };
 
+// What nearly everything in the game uses
+using BufferView = BasicBufferView<Endian::Little>;
+using BigEndianBufferView = BasicBufferView<Endian::Big>;
+
 
 template <size_t Size>
 std::ostream& operator<< (std::ostream& o, const std::array<byte, Size>& a) {
-	for (int i = 0; i < Size; i++) {
-		o.put(a[i]);
-	}
-
-	return o;
+	return o.write((const char *) a.data(), Size);
 }
 
 void WriteUTF16ToStream(std::ostream& o, const std::string& s);
@@ -251,4 +339,6 @@ std::array<byte, sizeof(T)> ToBytes(T val, bool bigEndian = true) {
 	return AsBytes<T>::Bytes(val, bigEndian);
 }
 
-void DumpToFile(const std::filesystem::path& p, const byte* start, const byte* end);
\ No newline at end of file
+void DumpToFile(const std::filesystem::path& p, const byte* start, const byte* end);
+// Writes the pieces back to back with vectored writes, no copying and no stream in between, false on failure
+bool DumpToFile(const std::filesystem::path& p, const std::vector<std::span<const byte>>& pieces);
\ No newline at end of file
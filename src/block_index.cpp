@@ -0,0 +1,133 @@
+#include "block_index.h"
+
+#include <format>
+#include <fstream>
+
+#include "spdlog/spdlog.h"
+
+#include "binary.h"
+#include "buffer_writer.h"
+#include "mapped_file.h"
+
+namespace fs = std::filesystem;
+
+const int block_index_version = 1;
+const size_t block_index_header_size = 0x28;
+const size_t block_index_entry_size = 0x28;
+
+static fs::path IndexPath(const fs::path& outputPath) {
+	fs::path result = outputPath;
+	result += ".blocks";
+
+	return result;
+}
+
+BlockIndex* BlockIndex::Load(const fs::path& outputPath) {
+	const fs::path indexPath = IndexPath(outputPath);
+
+	std::error_code error;
+
+	if (!fs::exists(indexPath, error)) {
+		return nullptr;
+	}
+
+	MappedFile* file = MappedFile::Open(indexPath, MappedFile::AccessPattern::Sequential);
+
+	if (!file) {
+		return nullptr;
+	}
+
+	BlockIndex* result = new BlockIndex();
+
+	try {
+		if (file->GetSize() < block_index_header_size) {
+			throw std::runtime_error("Truncated header");
+		}
+
+		BufferView dataView(file->GetData(), file->GetSize());
+
+		dataView.AssertASCII("GLBI", 4, "Magic Value");
+		dataView.AssertInt32(block_index_version, "Version");
+
+		result->level = dataView.ReadInt32();
+		result->strategy = dataView.ReadInt32();
+		result->entriesPerBlock = dataView.ReadInt32();
+		int blockCount = dataView.ReadInt32();
+		result->uncompressedSize = dataView.ReadInt64();
+		result->compressedSize = dataView.ReadInt64();
+
+		if (blockCount < 0 || block_index_header_size + (size_t) blockCount * block_index_entry_size > file->GetSize()) {
+			throw std::runtime_error(std::format("{} blocks don't fit in the file", blockCount));
+		}
+
+		result->blocks.reserve(blockCount);
+
+		for (int i = 0; i < blockCount; i++) {
+			BlockIndexEntry entry;
+
+			entry.start = dataView.ReadInt64();
+			entry.length = dataView.ReadInt64();
+			entry.crc = dataView.ReadInt32();
+			entry.adler = dataView.ReadInt32();
+			entry.compressedOffset = dataView.ReadInt64();
+			entry.compressedLength = dataView.ReadInt64();
+
+			result->blocks.push_back(entry);
+		}
+	} catch (const std::runtime_error& e) {
+		spdlog::warn("Ignoring the block index {}: {}", indexPath.string(), e.what());
+
+		delete result;
+		result = nullptr;
+	}
+
+	delete file;
+
+	return result;
+}
+
+bool BlockIndex::Save(const fs::path& outputPath) const {
+	const fs::path indexPath = IndexPath(outputPath);
+
+	BufferWriter index(block_index_header_size + this->blocks.size() * block_index_entry_size);
+
+	index.WriteASCII("GLBI", false);
+	index.WriteInt32(block_index_version);
+	index.WriteInt32(this->level);
+	index.WriteInt32(this->strategy);
+	index.WriteInt32(this->entriesPerBlock);
+	index.WriteInt32(this->blocks.size());
+	index.WriteInt64(this->uncompressedSize);
+	index.WriteInt64(this->compressedSize);
+
+	for (const auto& entry : this->blocks) {
+		index.WriteInt64(entry.start);
+		index.WriteInt64(entry.length);
+		index.WriteScalar<uint32_t>(entry.crc);
+		index.WriteScalar<uint32_t>(entry.adler);
+		index.WriteInt64(entry.compressedOffset);
+		index.WriteInt64(entry.compressedLength);
+	}
+
+	std::ofstream file(indexPath, std::ios::binary);
+
+	file.write((const char *) index.GetData(), index.GetSize());
+
+	file.close();
+
+	if (!file) {
+		spdlog::error("Couldn't write the block index {}", indexPath.string());
+
+		Remove(outputPath);
+
+		return false;
+	}
+
+	return true;
+}
+
+void BlockIndex::Remove(const fs::path& outputPath) {
+	std::error_code error;
+
+	fs::remove(IndexPath(outputPath), error);
+}
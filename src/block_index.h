@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Sidecar of an incrementally packed DCX, kept next to it as <output>.blocks
+// Maps every independently deflated block of the BND to its place in the compressed payload, so unchanged blocks can be copied into the next build
+struct BlockIndexEntry {
+	uint64_t start;
+	uint64_t length;
+	// Both checksums are of the uncompressed slice, crc to tell if it changed, adler to rebuild the stream trailer
+	uint32_t crc;
+	uint32_t adler;
+	// Relative to the start of the compressed payload
+	uint64_t compressedOffset;
+	uint64_t compressedLength;
+};
+
+class BlockIndex {
+public:
+	int level = 0;
+	int strategy = 0;
+	int entriesPerBlock = 0;
+	uint64_t uncompressedSize = 0;
+	uint64_t compressedSize = 0;
+	std::vector<BlockIndexEntry> blocks;
+
+	// nullptr if there's no index or it can't be read
+	static BlockIndex* Load(const std::filesystem::path& outputPath);
+	bool Save(const std::filesystem::path& outputPath) const;
+	static void Remove(const std::filesystem::path& outputPath);
+};
@@ -3,16 +3,33 @@
 #include <vector>
 #include <fstream>
 #include <chrono>
+#include <span>
 
 namespace stdtime = std::chrono;
 
 #include "binary.h"
 #include "dcx_file.h"
 #include "compression.h"
+#include "block_index.h"
+#include "parallel.h"
+#include "bnd_hash_table.h"
+#include "record_schema.h"
+
+const size_t bnd_header_size = 0x40;
+// Roughly how much data goes in a single reusable block when packing incrementally
+const size_t incremental_block_size = 0x10000;
+// Spare room after an unpacked BND, so small size changes can be relocated without a new buffer
+const size_t relocation_slack = 0x10000;
+const size_t hash_table_alignment = 8;
+// The BDF4 header in front of the payloads of a split BND
+const size_t bdf_header_size = 0x30;
 
 BNDFile::BNDFile(byte* backingData, size_t size):
 	backingData(backingData),
-	fileSize(size) {}
+	backingFile(nullptr),
+	fileSize(size),
+	backingCapacity(size),
+	qualifiedNames(&arena) {}
 
 BNDFile::~BNDFile() {
 	for (auto& segment : this->bindedFileInfos) {
@@ -21,10 +38,25 @@ BNDFile::~BNDFile() {
 		}
 	}
 
-	delete[] backingData;
+	ReleaseBackingData();
+
+	delete this->dataFile;
 }
 
-// Always does
+void BNDFile::ReleaseBackingData() {
+	if (this->backingFile) {
+		delete this->backingFile;
+
+		this->backingFile = nullptr;
+	}
+	else {
+		delete[] this->backingData;
+	}
+
+	this->backingData = nullptr;
+}
+
+// Always does, some entries may still be stored raw
 bool HasCompression(byte format) {
 	return format & 0b00100000;
 }
@@ -39,6 +71,11 @@ bool HasNames(byte format) {
 	return format & 0b00001100;
 }
 
+// The path hash table is there only with this extended flag
+bool HasHashTable(byte extended) {
+	return extended == 4;
+}
+
 byte DecodeFlags(byte readFormat, bool reverseBits) {
 	if (reverseBits || readFormat & 1 && !(readFormat & 0b10000000)) {
 		byte result = 0;
@@ -56,6 +93,27 @@ byte DecodeFlags(byte readFormat, bool reverseBits) {
 	}
 }
 
+// Unlike the format, file flags are only ever reversed because of the header flag
+byte DecodeFileFlags(byte readFlags, bool reverseBits) {
+	if (!reverseBits) {
+		return readFlags;
+	}
+
+	byte result = 0;
+
+	for (int i = 0; i < 8; i++) {
+		result |= (128 * (readFlags & 1)) >> i;
+
+		readFlags >>= 1;
+	}
+
+	return result;
+}
+
+// Decoded file flags
+const byte file_flag_compressed = 0b00000001;
+const byte file_flag_default = 0b01000000;
+
 constexpr int BindedFileInfo::GetSize() {
 	return (
 		1 // flags
@@ -68,281 +126,798 @@ constexpr int BindedFileInfo::GetSize() {
 	);
 }
 
-std::string BindedFileInfo::GetName() const {
-	std::filesystem::path networkPath = this->path;
-
-	return PathUtils::StemWindows(networkPath).string();
+std::string_view BindedFileInfo::GetName() const {
+	return PathUtils::StemWindowsView(this->path);
 }
 
 std::string BindedFileInfo::GetNameWithParentFolder() const {
-	std::filesystem::path networkPath = this->path;
+	std::filesystem::path networkPath = std::string_view(this->path);
 	networkPath = PathUtils::ChangeSlashes(networkPath);
 	
 	return (networkPath.parent_path().stem() / networkPath.stem()).string();
 }
 
 
-BindedFileInfo BNDFile::ReadBNDFileHeader(BufferView& dataView, byte format, bool reverseBits) {
+template<Endian Order>
+BNDFile::BindedFileRecord BNDFile::ReadBindedFileRecord(BasicBufferView<Order>& dataView) const {
+	using namespace Record;
+
 	// I am assuming a format of 01110100, since that's what all these have
-	byte flags = DecodeFlags(dataView.ReadByte(), reverseBits);
-	dataView.AssertByte(0);
-	dataView.AssertByte(0);
-	dataView.AssertByte(0);
-	dataView.AssertInt32(-1);
+	using Schema = RecordSchema<BindedFileRecord,
+		Field<&BindedFileRecord::flags>,
+		Padding<3>,
+		Expect<int, -1>,
+		Field<&BindedFileRecord::storedSize>,
+		Field<&BindedFileRecord::uncompressedSize>,
+		Field<&BindedFileRecord::dataOffset>,
+		Field<&BindedFileRecord::pathOffset>
+	>;
+
+	static_assert(Schema::size == BindedFileInfo::GetSize());
 
-	int fileSize = dataView.ReadInt64();
+	BindedFileRecord record = dataView.template ReadRecord<Schema>("BND file table entry");
 
-	int uncompressedSize = dataView.ReadInt64();
-	int dataOffset = dataView.ReadInt64();
+	record.flags = DecodeFileFlags(record.flags, this->header.reverseFlagBits);
 
-	int pathOffset = dataView.ReadInt32();
-	std::string filePath = dataView.ReadOffsetUTF16(pathOffset);
-	byte* fileContent = new byte[uncompressedSize];
+	return record;
+}
+
+void BNDFile::ReadHeader(BufferView& dataView) {
+	using namespace Record;
 
-	memcpy(fileContent, this->backingData + dataOffset, uncompressedSize);
+	// A BHF4 is the same thing with the payloads moved out to a BDF4
+	std::string magic = dataView.ReadASCII(4);
 
-	return BindedFileInfo(filePath, flags, fileContent, uncompressedSize);
+	if (magic != (this->dataFile ? "BHF4" : "BND4")) {
+		throw std::runtime_error(std::format("Unexpected magic value: {}", magic));
+	}
+
+	// Everything after these is in the byte order they give
+	struct Flags {
+		bool unk04;
+		bool unk05;
+		bool bigEndian;
+		bool forwardBits;
+	};
+
+	const Flags flags = dataView.ReadRecord<RecordSchema<Flags,
+		Field<&Flags::unk04>,
+		Field<&Flags::unk05>,
+		Padding<3>,
+		Field<&Flags::bigEndian>,
+		Field<&Flags::forwardBits>,
+		Padding<1>
+	>>("BND header flags");
+
+	struct Fields {
+		int fileCount;
+		uint64_t version;
+		bool unicode;
+		byte format;
+		byte extended;
+		uint64_t hashTableOffset;
+	};
+
+	using FieldsSchema = RecordSchema<Fields,
+		Field<&Fields::fileCount>,
+		Expect<uint64_t, 0x40>, // Header size
+		Field<&Fields::version>,
+		Skip<8>, // File header size
+		Skip<8>, // Headers end
+		Field<&Fields::unicode>,
+		Field<&Fields::format>,
+		Field<&Fields::extended>,
+		Padding<5>,
+		Field<&Fields::hashTableOffset>
+	>;
+
+	const Fields fields = flags.bigEndian
+		? dataView.As<Endian::Big>().ReadRecord<FieldsSchema>("BND header")
+		: dataView.ReadRecord<FieldsSchema>("BND header");
+
+	const bool reverseBits = !flags.forwardBits;
+	const byte format = DecodeFlags(fields.format, reverseBits);
+
+	// We actually always have one
+	if (!HasHashTable(fields.extended) && fields.hashTableOffset != 0) {
+		throw std::runtime_error(std::format("Hash table offset without a hash table: {:#x}", fields.hashTableOffset));
+	}
+
+	if (fields.fileCount < 0) {
+		throw std::runtime_error(std::format("Invalid file count: {}", fields.fileCount));
+	}
+
+	// The file table is read and written with uncompressed sizes
+	if (!HasCompression(format)) {
+		throw std::runtime_error(std::format("Unsupported format without uncompressed sizes: {:#x}", format));
+	}
+
+	this->header = BNDFileHeader {
+		flags.unk04,
+		flags.unk05,
+		flags.bigEndian,
+		reverseBits,
+		fields.fileCount,
+		fields.version,
+		fields.unicode,
+		format,
+		fields.extended,
+		fields.hashTableOffset
+	};
 }
 
-BNDFile* BNDFile::Parse(const byte* data, size_t dataLength) {
-	try {
-		BufferView dataView(data, dataLength, false);
+void BNDFile::ParseAvailable(size_t availableLength) {
+	const size_t viewLength = std::min(availableLength, this->fileSize);
 
-		dataView.AssertASCII("BND4", "Magic Value");
+	if (this->parseStage == ParseStage::Header) {
+		if (availableLength < bnd_header_size) {
+			return;
+		}
 
-		bool unk04 = dataView.ReadBoolean();
-		bool unk05 = dataView.ReadBoolean();
-		dataView.AssertByte(0, "Padding 1");
-		dataView.AssertByte(0, "Padding 2");
-		dataView.AssertByte(0, "Padding 3");
-		bool bigEndian = dataView.ReadBoolean();
-		bool reverseBits = !dataView.ReadBoolean();
-		dataView.AssertByte(0, "Padding 4");
+		BufferView headerView(this->backingData, viewLength);
 
-		dataView.SetBigEndian(bigEndian);
+		ReadHeader(headerView);
 
-		int fileCount = dataView.ReadInt32();
-		dataView.AssertInt64(0x40, "Header size");
-		uint64_t version = dataView.ReadInt64();
+		this->parseStage = ParseStage::FileTable;
+	}
 
-		int fileHeaderSize = dataView.ReadInt64();
+	WithByteOrder([&](auto& dataView) {
+		ParseTables(dataView, availableLength);
+	}, this->backingData, viewLength);
+}
 
-		dataView.Skip<uint64_t>();
+template<Endian Order>
+void BNDFile::ParseTables(BasicBufferView<Order>& dataView, size_t availableLength) {
+	if (this->parseStage == ParseStage::FileTable) {
+		size_t fileTableEnd = bnd_header_size + (size_t) this->header.fileCount * BindedFileInfo::GetSize();
 
-		bool unicode = dataView.ReadBoolean();
-		byte format = DecodeFlags(dataView.ReadByte(), reverseBits);
+		if (availableLength < fileTableEnd) {
+			return;
+		}
 
-		byte extended = dataView.ReadByte();
+		dataView.SetOffset(bnd_header_size);
 
-		dataView.AssertByte(0, "Padding 5");
-		dataView.AssertInt32(0, "Padding 6");
+		this->pendingRecords.reserve(this->header.fileCount);
 
-		if (extended == 4) { // We actually always take this branch
-			dataView.Advance(8);
+		size_t payloadsStart = this->fileSize;
 
-			// SoulsFormats does some shit here, we don't actually need it
+		for (int i = 0; i < this->header.fileCount; i++) {
+			auto record = ReadBindedFileRecord(dataView);
+
+			if (record.dataOffset + record.storedSize > GetPayloadLimit()) {
+				throw std::runtime_error(std::format("File {} lies outside of the BND: offset= {} length= {}", i, record.dataOffset, record.storedSize));
+			}
+
+			// Offsets into the data file say nothing about where the names end
+			if (!this->dataFile) {
+				payloadsStart = std::min(payloadsStart, record.dataOffset);
+			}
+
+			this->pendingRecords.push_back(record);
 		}
-		else {
-			dataView.AssertInt64(0, "Hash table size");
+
+		// The names sit between the file table and the payloads, unless someone decided otherwise
+		this->namesEnd = payloadsStart;
+
+		for (const auto& record : this->pendingRecords) {
+			if ((size_t) record.pathOffset >= payloadsStart) {
+				this->namesEnd = this->fileSize;
+
+				break;
+			}
 		}
 
-		BNDFileHeader header {
-			unk04,
-			unk05,
-			bigEndian,
-			reverseBits,
-			fileCount,
-			version,
-			unicode,
-			format
-		};
+		// Same for the hash table, it's read along with the names
+		if (this->header.hashTableOffset >= payloadsStart) {
+			this->namesEnd = this->fileSize;
+		}
 
-		BNDFile* result = new BNDFile(const_cast<byte *>(data), dataLength);
+		this->parseStage = ParseStage::Names;
+	}
 
-		result->header = header;
-		result->bindedFileInfos.reserve(fileCount);
-		for (int i = 0; i < fileCount; i++) {
-			auto fileHeader = result->ReadBNDFileHeader(dataView, format, reverseBits);
+	if (this->parseStage == ParseStage::Names) {
+		if (availableLength < this->namesEnd) {
+			return;
+		}
 
-			result->bindedFileInfos.push_back(fileHeader);
+		// The index keeps views into the paths, so the entries must never move
+		this->bindedFileInfos.reserve(this->header.fileCount);
+		this->matbinIndex.Reserve(this->header.fileCount);
 
-			if (result->matbinFileMap.contains(fileHeader.GetName())) {
-				auto newName = fileHeader.GetNameWithParentFolder();
+		for (int i = 0; i < this->header.fileCount; i++) {
+			const auto& record = this->pendingRecords[i];
 
-				spdlog::warn("Path conflict: {} and {}, the second one will be saved as {}", result->matbinFileMap[fileHeader.GetName()]->path, fileHeader.path, newName);
+			this->bindedFileInfos.push_back(BindedFileInfo(dataView.ReadOffsetUTF16(record.pathOffset, &this->arena), record.flags, nullptr, record.storedSize));
 
-				result->matbinFileMap[newName] = &result->bindedFileInfos[i];
+			if (record.flags & file_flag_compressed) {
+				this->bindedFileInfos.back().compressed = true;
+				this->bindedFileInfos.back().uncompressedSize = record.uncompressedSize;
 			}
-			else {
-				result->matbinFileMap[fileHeader.GetName()] = &result->bindedFileInfos[i];
+
+			const auto& fileHeader = this->bindedFileInfos.back();
+
+			if (!this->matbinIndex.Insert(fileHeader.GetName(), i)) {
+				const auto& newName = this->qualifiedNames.emplace_back(fileHeader.GetNameWithParentFolder());
+
+				spdlog::warn("Path conflict: {} and {}, the second one will be saved as {}", this->bindedFileInfos[this->matbinIndex.Find(fileHeader.GetName())->value].path, fileHeader.path, newName);
+
+				if (!this->matbinIndex.Insert(newName, i)) {
+					spdlog::error("Path conflict: {} is taken as well, {} can't be modded", newName, fileHeader.path);
+				}
 			}
 		}
 
+		if (this->header.hashTableOffset != 0) {
+			try {
+				dataView.SetOffset(this->header.hashTableOffset);
+
+				this->hashTable = BNDHashTable::Read(dataView, this->header.fileCount);
+			} catch (const std::exception& e) {
+				spdlog::warn("Ignoring the broken path hash table: {}", e.what());
+			}
+		}
+
+		// Not every BND has one, path lookups work the same either way
+		if (this->hashTable.IsEmpty()) {
+			std::vector<std::string_view> paths;
+			paths.reserve(this->bindedFileInfos.size());
+
+			for (const auto& bindedFile : this->bindedFileInfos) {
+				paths.push_back(bindedFile.path);
+			}
+
+			this->hashTable = BNDHashTable::Build(paths);
+		}
+
+		this->parseStage = ParseStage::Payloads;
+	}
+
+	if (this->parseStage == ParseStage::Payloads) {
+		for (; this->nextPayload < this->pendingRecords.size(); this->nextPayload++) {
+			const auto& record = this->pendingRecords[this->nextPayload];
+
+			// The data file is mapped, so that's all available from the start
+			if (!this->dataFile && record.dataOffset + record.storedSize > availableLength) {
+				return;
+			}
+
+			// Just a view, nothing gets copied until a matbin has to grow
+			// Compressed entries stay compressed until someone asks for them
+			this->bindedFileInfos[this->nextPayload].dataLocation.start = GetPayloadBase() + record.dataOffset;
+		}
+
+		this->pendingRecords.clear();
+		this->pendingRecords.shrink_to_fit();
+
+		this->parseStage = ParseStage::Done;
+	}
+}
+
+BNDFile* BNDFile::Parse(const byte* data, size_t dataLength) {
+	BNDFile* result = new BNDFile(const_cast<byte *>(data), dataLength);
+
+	try {
+		result->ParseAvailable(dataLength);
+
+		if (result->parseStage != ParseStage::Done) {
+			throw std::runtime_error("The BND file is truncated");
+		}
+
 		return result;
-	} catch (const std::runtime_error& e) {
+	} catch (const std::exception& e) {
 		spdlog::error("Caught exception when parsing the BND file: {}", e.what());
 
+		// The caller still owns the data on failure
+		result->backingData = nullptr;
+		delete result;
+
 		return nullptr;
 	}
 }
 
 void BNDFile::Write(const std::filesystem::path& dest) {
-	std::ofstream file(dest, std::ios::binary);
-
-	file << ToBytes<4>("BND4");
-
-	file << ToBytes(this->header.unk04);
-	file << ToBytes(this->header.unk05);
-	file << ToBytes((bool) 0);
-	file << ToBytes((bool) 0);
-	file << ToBytes((bool) 0);
-	file << ToBytes(this->header.bigEndian);
-	file << ToBytes(!this->header.reverseFlagBits);
-	file << ToBytes((bool) 0);
-	file << ToBytes((int) this->bindedFileInfos.size(), this->header.bigEndian);
-	file << ToBytes((uint64_t) 0x40, this->header.bigEndian);
-	file << ToBytes(this->header.version, this->header.bigEndian);
-	file << ToBytes((uint64_t) BindedFileInfo::GetSize(), this->header.bigEndian);
-	file << ToBytes((uint64_t) 0);
-	file << ToBytes(this->header.unicode);
-	file << ToBytes(DecodeFlags(this->header.format, this->header.reverseFlagBits));
-	file << ToBytes((byte) 0);
-	file << ToBytes((byte) 0);
-	file << ToBytes((int) 0);
-	file << ToBytes((uint64_t) 0);
-
-	size_t headersStartOffset = file.tellp();
-	size_t baseOffset = headersStartOffset + this->bindedFileInfos.size() * BindedFileInfo::GetSize();
-	size_t nameOffset = 0;
+	PrepareStoredPayloads();
 
-	for (const auto& bindedFile : this->bindedFileInfos) {
-		file << ToBytes(DecodeFlags(0b01000000, this->header.reverseFlagBits));
-		file << ToBytes((byte) 0);
-		file << ToBytes((byte) 0);
-		file << ToBytes((byte) 0);
-		file << ToBytes(-1, this->header.bigEndian);
-		file << ToBytes(bindedFile.GetFileSize(), this->header.bigEndian);
-		file << ToBytes(bindedFile.GetFileSize(), this->header.bigEndian);
-		file << ToBytes((int64_t) -1); // File offset
-		file << ToBytes((int) (baseOffset + nameOffset), this->header.bigEndian); // Name offset
+	// Only the tables need to be built, the payloads go out straight from wherever they already are
+	WithByteOrder<BasicBufferWriter>([&](auto& tables) {
+		WriteTables(tables);
+
+		std::vector<std::span<const byte>> pieces;
+		pieces.reserve(this->bindedFileInfos.size() + 1);
+		pieces.push_back(tables.GetWritten());
+
+		for (const auto& bindedFile : this->bindedFileInfos) {
+			pieces.emplace_back(bindedFile.GetStoredData(), bindedFile.GetStoredSize());
+		}
+
+		if (!DumpToFile(dest, pieces)) {
+			spdlog::error("Couldn't write the BND to {}", dest.string());
+		}
+	}, GetTablesSize());
+}
 
-		nameOffset += (bindedFile.path.size() + 1) * 2;
+BNDFile* BNDFile::Open(const std::filesystem::path& filePath) {
+	MappedFile* file = MappedFile::Open(filePath, MappedFile::AccessPattern::Sequential);
+
+	if (!file) {
+		return nullptr;
 	}
 
-	for (const auto& bindedFile : this->bindedFileInfos) {
-		WriteUTF16ToStream(file, bindedFile.path);
+	BNDFile* result = BNDFile::Parse(file->GetData(), file->GetSize());
+
+	if (!result) {
+		delete file;
+
+		return nullptr;
 	}
 
-	int i = 0;
-	for (const auto& bindedFile : this->bindedFileInfos) {
-		auto currentPos = file.tellp();
+	result->backingFile = file;
 
-		file.seekp(headersStartOffset + (i * BindedFileInfo::GetSize()) + 24);
+	return result;
+}
 
-		file << ToBytes((int64_t) currentPos, this->header.bigEndian);
+BNDFile* BNDFile::OpenSplit(const std::filesystem::path& headerPath, const std::filesystem::path& dataPath) {
+	MappedFile* headerFile = MappedFile::Open(headerPath, MappedFile::AccessPattern::Sequential);
 
-		file.seekp(currentPos);
+	if (!headerFile) {
+		return nullptr;
+	}
 
-		if (bindedFile.loaded) {
-			file.write((char *) bindedFile.matbin->GetStart(), bindedFile.matbin->GetLength());
-		}
-		else {
-			file.write((char *) bindedFile.dataLocation.start, bindedFile.dataLocation.length);
+	// Nothing in here is read until an entry is asked for
+	MappedFile* dataFile = MappedFile::Open(dataPath, MappedFile::AccessPattern::Random);
+
+	if (!dataFile) {
+		delete headerFile;
+
+		return nullptr;
+	}
+
+	BNDFile* result = new BNDFile(headerFile->GetData(), headerFile->GetSize());
+
+	result->backingFile = headerFile;
+	result->dataFile = dataFile;
+
+	try {
+		BufferView dataHeader(dataFile->GetData(), dataFile->GetSize());
+
+		dataHeader.AssertASCII("BDF4", "BDF4 Magic Value");
+
+		result->ParseAvailable(headerFile->GetSize());
+
+		if (result->parseStage != ParseStage::Done) {
+			throw std::runtime_error("The BHF4 file is truncated");
 		}
 
-		i++;
+		return result;
+	} catch (const std::exception& e) {
+		spdlog::error("Caught exception when parsing the split BND {}: {}", headerPath.string(), e.what());
+
+		delete result;
+
+		return nullptr;
 	}
+}
+
+void BNDFile::WriteSplit(const std::filesystem::path& headerDest, const std::filesystem::path& dataDest) {
+	PrepareStoredPayloads();
 
-	file.close();
+	WithByteOrder<BasicBufferWriter>([&](auto& tables) {
+		WriteTables(tables, true);
+
+		if (!DumpToFile(headerDest, { tables.GetWritten() })) {
+			spdlog::error("Couldn't write the BHF4 to {}", headerDest.string());
+		}
+	}, GetTablesSize());
+
+	WithByteOrder<BasicBufferWriter>([&](auto& dataHeader) {
+		dataHeader.WriteASCII("BDF4", false);
+		dataHeader.WriteBool(this->header.unk04);
+		dataHeader.WriteBool(this->header.unk05);
+		dataHeader.WriteZeroes(3);
+		dataHeader.WriteBool(this->header.bigEndian);
+		dataHeader.WriteBool(!this->header.reverseFlagBits);
+		dataHeader.WriteBool(0);
+		dataHeader.WriteInt32(0);
+		dataHeader.WriteInt64(bdf_header_size);
+		dataHeader.WriteInt64(this->header.version);
+		dataHeader.WriteInt64(0);
+		dataHeader.WriteInt64(0);
+
+		std::vector<std::span<const byte>> pieces;
+		pieces.reserve(this->bindedFileInfos.size() + 1);
+		pieces.push_back(dataHeader.GetWritten());
+
+		for (const auto& bindedFile : this->bindedFileInfos) {
+			pieces.emplace_back(bindedFile.GetStoredData(), bindedFile.GetStoredSize());
+		}
+
+		if (!DumpToFile(dataDest, pieces)) {
+			spdlog::error("Couldn't write the BDF4 to {}", dataDest.string());
+		}
+	}, bdf_header_size);
 }
 
 BNDFile* BNDFile::Unpack(const DCXFile* file) {
-	size_t actualDecompressedSize = 0;
-	byte* outFileBuffer = file->Decompress(actualDecompressedSize);
+	const auto startTime = stdtime::high_resolution_clock::now();
 
-	auto result = BNDFile::Parse(outFileBuffer, actualDecompressedSize);
+	const size_t decompressedSize = file->GetUncompressedSize();
+	byte* outFileBuffer = new byte[decompressedSize + relocation_slack];
 
-	if (!result) {
-		delete outFileBuffer;
+	// The BND takes ownership of the buffer right away, its header and file table get parsed while the payloads are still inflating
+	BNDFile* result = new BNDFile(outFileBuffer, decompressedSize);
+	result->backingCapacity = decompressedSize + relocation_slack;
+	size_t availableLength = 0;
+
+	bool decompressed = file->DecompressChunked(outFileBuffer, [&](const byte* chunk, size_t chunkLength) {
+		availableLength += chunkLength;
+
+		try {
+			result->ParseAvailable(availableLength);
+
+			return true;
+		} catch (const std::exception& e) {
+			spdlog::error("Caught exception when parsing the BND file: {}", e.what());
+
+			return false;
+		}
+	});
+
+	if (!decompressed || result->parseStage != ParseStage::Done) {
+		spdlog::error("Couldn't unpack the BND, got {}/{} bytes", availableLength, decompressedSize);
+
+		delete result;
 
 		return nullptr;
 	}
-	else {
-		return result;
+
+	const auto endTime = stdtime::high_resolution_clock::now();
+
+	spdlog::info("Decompressed and parsed the BND, took {}", stdtime::duration_cast<stdtime::milliseconds>(endTime - startTime));
+
+	return result;
+}
+
+void BNDFile::PrepareStoredPayloads() {
+	for (auto& bindedFile : this->bindedFileInfos) {
+		if (!bindedFile.loaded || !bindedFile.compressed) {
+			continue;
+		}
+
+		if (!this->keepEntriesCompressed) {
+			bindedFile.compressed = false;
+
+			continue;
+		}
+
+		const DCXCodec* codec = DCXCodec::Default();
+		byte* compressedData = new byte[codec->GetMaxCompressedLen(bindedFile.matbin->GetLength())];
+
+		int level = 0;
+		int compressedSize = codec->Compress(bindedFile.matbin->GetStart(), bindedFile.matbin->GetLength(), compressedData, codec->GetMaxCompressedLen(bindedFile.matbin->GetLength()), CompressionPolicy(), level);
+
+		if (compressedSize < 0) {
+			spdlog::error("Couldn't compress {}, storing it raw", bindedFile.path);
+
+			delete[] compressedData;
+
+			bindedFile.compressed = false;
+
+			continue;
+		}
+
+		// The DCX takes ownership of the buffer
+		DCXFile packed(compressedSize, bindedFile.matbin->GetLength(), 8, compressedData, codec);
+
+		bindedFile.packedData = packed.Serialize();
 	}
 }
 
-void BNDFile::Relocate() {
-	byte* newLocation = new byte[this->GetSize()];
-	BufferView data(newLocation, this->GetSize(), true);
+size_t BNDFile::GetHashTableOffset() const {
+	size_t namesEnd = bnd_header_size + this->bindedFileInfos.size() * BindedFileInfo::GetSize();
+
+	for (const auto& bindedFile : this->bindedFileInfos) {
+		namesEnd += UTF16::GetEncodedSize(bindedFile.path);
+	}
+
+	return (namesEnd + hash_table_alignment - 1) / hash_table_alignment * hash_table_alignment;
+}
+
+size_t BNDFile::GetTablesSize() const {
+	if (HasHashTable(this->header.extended)) {
+		return GetHashTableOffset() + BNDHashTable::GetWrittenSize(this->bindedFileInfos.size());
+	}
+
+	size_t result = bnd_header_size + this->bindedFileInfos.size() * BindedFileInfo::GetSize();
+
+	for (const auto& bindedFile : this->bindedFileInfos) {
+		result += UTF16::GetEncodedSize(bindedFile.path);
+	}
 
-	data.WriteASCII("BND4", false);
+	return result;
+}
+
+template<Endian Order>
+void BNDFile::WriteTables(BasicBufferWriter<Order>& data, bool split) const {
+	const size_t fileCount = this->bindedFileInfos.size();
+
+	data.WriteASCII(split ? "BHF4" : "BND4", false);
 	data.WriteBool(this->header.unk04);
 	data.WriteBool(this->header.unk05);
-	data.Write<3>({0});
+	data.WriteZeroes(3);
 	data.WriteBool(this->header.bigEndian);
 	data.WriteBool(!this->header.reverseFlagBits);
 	data.WriteBool(0);
-	data.SetBigEndian(this->header.bigEndian);
-	data.WriteInt32(this->bindedFileInfos.size());
-	data.WriteInt64(0x40);
+	data.WriteInt32(fileCount);
+	data.WriteInt64(bnd_header_size);
 	data.WriteInt64(this->header.version);
 	data.WriteInt64(BindedFileInfo::GetSize());
-	data.WriteInt64(0);
+	auto headersEnd = data.template ReserveSlot<uint64_t>();
 	data.WriteBool(this->header.unicode);
 	data.WriteByte(DecodeFlags(this->header.format, this->header.reverseFlagBits));
-	data.WriteByte(0);
+	data.WriteByte(this->header.extended);
 	data.WriteByte(0);
 	data.WriteInt32(0);
-	data.WriteInt64(0);
+	auto hashTableOffset = data.template ReserveSlot<uint64_t>();
+
+	using PathSlot = typename BasicBufferWriter<Order>::template Slot<int>;
+	using PayloadSlot = typename BasicBufferWriter<Order>::template Slot<uint64_t>;
 
-	size_t headersStartOffset = data.GetOffset();
-	size_t baseOffset = headersStartOffset + this->bindedFileInfos.size() * BindedFileInfo::GetSize();
-	size_t pathOffset = 0;
+	std::vector<PathSlot> pathSlots;
+	std::vector<PayloadSlot> payloadSlots;
+	pathSlots.reserve(fileCount);
+	payloadSlots.reserve(fileCount);
 
 	for (const auto& bindedFile : this->bindedFileInfos) {
-		data.WriteByte(DecodeFlags(0b01000000, this->header.reverseFlagBits));
-		data.Write<3>({0});
+		data.WriteByte(DecodeFileFlags(bindedFile.compressed ? file_flag_default | file_flag_compressed : file_flag_default, this->header.reverseFlagBits));
+		data.WriteZeroes(3);
 		data.WriteInt32(-1);
+		data.WriteInt64(bindedFile.GetStoredSize());
 		data.WriteInt64(bindedFile.GetFileSize());
-		data.WriteInt64(bindedFile.GetFileSize());
-		data.WriteInt64(-1); // File offset, we'll get to it later
-		data.WriteInt32(baseOffset + pathOffset); // Path offset
+		payloadSlots.push_back(data.template ReserveSlot<uint64_t>());
+		pathSlots.push_back(data.template ReserveSlot<int>());
+	}
 
-		pathOffset += (bindedFile.path.size() + 1) * 2;
+	for (size_t i = 0; i < fileCount; i++) {
+		data.FillWithOffset(pathSlots[i]);
+		data.WriteUTF16(this->bindedFileInfos[i].path);
 	}
 
-	for (const auto& bindedFile : this->bindedFileInfos) {
-		data.WriteUTF16(bindedFile.path);
+	// Always rebuilt from the paths, whatever the source file had
+	if (HasHashTable(this->header.extended)) {
+		std::vector<std::string_view> paths;
+		paths.reserve(fileCount);
+
+		for (const auto& bindedFile : this->bindedFileInfos) {
+			paths.push_back(bindedFile.path);
+		}
+
+		data.AlignTo(hash_table_alignment);
+		data.FillWithOffset(hashTableOffset);
+
+		BNDHashTable::Build(paths).Write(data);
 	}
 
-	int i = 0;
-	for (const auto& bindedFile : this->bindedFileInfos) {
-		auto currentPos = data.GetOffset();
+	// The payloads go right after the tables in entry order, or after the BDF4 header
+	data.Fill(headersEnd, split ? 0 : data.GetOffset());
+
+	uint64_t payloadOffset = split ? bdf_header_size : data.GetOffset();
+
+	for (size_t i = 0; i < fileCount; i++) {
+		data.Fill(payloadSlots[i], payloadOffset);
+
+		payloadOffset += this->bindedFileInfos[i].GetStoredSize();
+	}
+}
+
+void BNDFile::Relocate() {
+	PrepareStoredPayloads();
+
+	if (!RelocateInPlace()) {
+		RelocateToNewBuffer();
+	}
+}
+
+bool BNDFile::RelocateInPlace() {
+	// Becoming a single BND always takes a new buffer
+	if (this->dataFile) {
+		return false;
+	}
 
-		data.SetOffset(headersStartOffset + (i * BindedFileInfo::GetSize()) + 24);
+	const size_t fileCount = this->bindedFileInfos.size();
 
-		data.WriteInt64(currentPos);
+	std::vector<uint64_t> oldOffsets(fileCount);
+	std::vector<uint64_t> oldSizes(fileCount);
 
-		data.SetOffset(currentPos);
+	WithByteOrder([&](auto& table) {
+		for (size_t i = 0; i < fileCount; i++) {
+			table.SetOffset(bnd_header_size + i * BindedFileInfo::GetSize() + 8);
 
-		if (bindedFile.loaded) {
-			data.WriteData(bindedFile.matbin->GetStart(), bindedFile.matbin->GetLength());
+			oldSizes[i] = table.ReadInt64();
+			table.template Skip<uint64_t>();
+			oldOffsets[i] = table.ReadInt64();
 		}
-		else {
-			data.WriteData(bindedFile.dataLocation.start, bindedFile.dataLocation.length);
+	}, this->backingData, this->fileSize);
+
+	// Shifting only works if the payloads follow the names in entry order, which they do in every BND we've seen
+	size_t previousEnd = GetTablesSize();
+
+	for (size_t i = 0; i < fileCount; i++) {
+		if (oldOffsets[i] < previousEnd) {
+			spdlog::info("The BND payloads aren't stored in order, relocating to a new buffer");
+
+			return false;
 		}
 
-		i++;
+		previousEnd = oldOffsets[i] + oldSizes[i];
+	}
+
+	// A hash table after the payloads would get run over
+	if (fileCount > 0 && this->header.hashTableOffset >= oldOffsets[0]) {
+		spdlog::info("The BND hash table is stored after the payloads, relocating to a new buffer");
+
+		return false;
+	}
+
+	// Every payload keeps the gap before it, so it only moves by however much the ones before it grew
+	std::vector<uint64_t> newOffsets(fileCount);
+	int64_t shift = 0;
+	size_t firstChanged = fileCount;
+
+	for (size_t i = 0; i < fileCount; i++) {
+		const auto& bindedFile = this->bindedFileInfos[i];
+
+		newOffsets[i] = oldOffsets[i] + shift;
+		shift += (int64_t) bindedFile.GetStoredSize() - (int64_t) oldSizes[i];
+
+		if (firstChanged == fileCount && (shift != 0 || bindedFile.GetStoredData() != this->backingData + oldOffsets[i])) {
+			firstChanged = i;
+		}
 	}
 
-	delete[] this->backingData;
+	const size_t newSize = this->fileSize + shift;
+
+	if (newSize > this->backingCapacity) {
+		spdlog::info("The BND grew by {} bytes, more than the {} spare ones, relocating to a new buffer", shift, this->backingCapacity - this->fileSize);
+
+		return false;
+	}
+
+	// Whatever's still in the buffer is moved first, the growing ones from the back and the shrinking ones from the front, so nothing gets overwritten before it's moved
+	auto isInPlace = [&](size_t i) {
+		return this->bindedFileInfos[i].GetStoredData() == this->backingData + oldOffsets[i];
+	};
+
+	for (size_t i = fileCount; i-- > firstChanged;) {
+		if (newOffsets[i] > oldOffsets[i] && isInPlace(i)) {
+			memmove(this->backingData + newOffsets[i], this->backingData + oldOffsets[i], oldSizes[i]);
+		}
+	}
+
+	for (size_t i = firstChanged; i < fileCount; i++) {
+		if (newOffsets[i] < oldOffsets[i] && isInPlace(i)) {
+			memmove(this->backingData + newOffsets[i], this->backingData + oldOffsets[i], oldSizes[i]);
+		}
+	}
+
+	for (size_t i = firstChanged; i < fileCount; i++) {
+		auto& bindedFile = this->bindedFileInfos[i];
+		byte* newLocation = this->backingData + newOffsets[i];
+
+		if (!isInPlace(i)) {
+			memcpy(newLocation, bindedFile.GetStoredData(), bindedFile.GetStoredSize());
+		}
+
+		// The padding after it is stale now
+		size_t end = newOffsets[i] + bindedFile.GetStoredSize();
+		size_t nextStart = i + 1 < fileCount ? newOffsets[i + 1] : newSize;
+
+		memset(this->backingData + end, 0, nextStart - end);
+
+		if (!bindedFile.loaded) {
+			bindedFile.dataLocation.start = newLocation;
+		}
+		else if (!bindedFile.compressed) {
+			bindedFile.matbin->Rebase(newLocation);
+		}
+	}
+
+	// The names and the table layout stay the same, only the sizes, flags and offsets need patching
+	WithByteOrder([&](auto& table) {
+		for (size_t i = 0; i < fileCount; i++) {
+			const auto& bindedFile = this->bindedFileInfos[i];
+
+			table.SetOffset(bnd_header_size + i * BindedFileInfo::GetSize());
+
+			table.WriteByte(DecodeFileFlags(bindedFile.compressed ? file_flag_default | file_flag_compressed : file_flag_default, this->header.reverseFlagBits));
+			table.template Skip<byte, 7>();
+			table.WriteInt64(bindedFile.GetStoredSize());
+			table.WriteInt64(bindedFile.GetFileSize());
+			table.WriteInt64(newOffsets[i]);
+		}
+	}, this->backingData, this->fileSize);
+
+	if (firstChanged < fileCount) {
+		spdlog::info("Relocated the BND in place from entry {}/{}, {} bytes moved", firstChanged, fileCount, newSize - newOffsets[firstChanged]);
+	}
+
+	this->fileSize = newSize;
+	this->sizeDelta = 0;
+	this->modified = false;
+
+	return true;
+}
+
+void BNDFile::RelocateToNewBuffer() {
+	// Only a hint, the writer grows if it's off
+	size_t expectedSize = GetTablesSize();
+
+	for (const auto& bindedFile : this->bindedFileInfos) {
+		expectedSize += bindedFile.GetStoredSize();
+	}
+
+	std::vector<size_t> payloadOffsets;
+	payloadOffsets.reserve(this->bindedFileInfos.size());
+
+	size_t newSize = 0;
+	size_t newCapacity = 0;
+
+	// Leaves room for the next few small changes to be relocated in place
+	byte* newLocation = WithByteOrder<BasicBufferWriter>([&](auto& data) {
+		WriteTables(data);
+
+		// The payloads are only copied, so that part doesn't care about the byte order
+		for (const auto& bindedFile : this->bindedFileInfos) {
+			payloadOffsets.push_back(data.GetOffset());
+
+			data.WriteData(bindedFile.GetStoredData(), bindedFile.GetStoredSize());
+		}
+
+		newSize = data.GetSize();
+		data.Reserve(newSize + relocation_slack);
+		newCapacity = data.GetCapacity();
+
+		return data.Release();
+	}, expectedSize + relocation_slack);
+
+	// Everything that's stored raw now has an up to date copy in the new buffer, so it can point there instead
+	for (size_t j = 0; j < this->bindedFileInfos.size(); j++) {
+		auto& bindedFile = this->bindedFileInfos[j];
+
+		if (!bindedFile.loaded) {
+			bindedFile.dataLocation.start = newLocation + payloadOffsets[j];
+		}
+		else if (!bindedFile.compressed) {
+			bindedFile.matbin->Rebase(newLocation + payloadOffsets[j]);
+		}
+	}
+
+	ReleaseBackingData();
+
+	// Nothing points into the data file anymore, this is a plain BND4 from here on
+	delete this->dataFile;
+	this->dataFile = nullptr;
 
 	this->backingData = newLocation;
+	this->fileSize = newSize;
+	this->backingCapacity = newCapacity;
+	this->sizeDelta = 0;
+	this->modified = false;
 }
 
-DCXFile* BNDFile::Pack(size_t compressedHeaderLength) {
-	if (this->sizeDelta != 0) {
+const DCXCodec* GetPolicyCodec(const CompressionPolicy& policy) {
+	const DCXCodec* codec = DCXCodec::Find(policy.codec);
+
+	if (!codec) {
+		spdlog::error("Unknown DCX codec {}, falling back to {}", policy.codec, DCXCodec::Default()->GetMagic());
+
+		codec = DCXCodec::Default();
+	}
+
+	return codec;
+}
+
+DCXFile* BNDFile::Pack(const CompressionPolicy& policy, size_t compressedHeaderLength) {
+	if (this->sizeDelta != 0 || this->modified || this->dataFile) {
 		spdlog::info("Relocating the BND in memory");
 
 		Relocate();
@@ -350,67 +925,398 @@ DCXFile* BNDFile::Pack(size_t compressedHeaderLength) {
 
 	const auto startTime = stdtime::high_resolution_clock::now();
 
-	const size_t expectedCompressedSize = 8e7;
+	const DCXCodec* codec = GetPolicyCodec(policy);
+
+	const size_t expectedCompressedSize = codec->GetMaxCompressedLen(this->GetSize());
 
 	byte* compressedData = new byte[expectedCompressedSize];
 
-	int actualCompressedSize = CompressData(this->backingData, this->fileSize + this->sizeDelta, compressedData, expectedCompressedSize);
+	int level = 0;
+	int actualCompressedSize = codec->Compress(this->backingData, this->GetSize(), compressedData, expectedCompressedSize, policy, level);
+
+	const auto endTime = stdtime::high_resolution_clock::now();
+
+	spdlog::info(
+		"Compressed the BND with {} (used level {}), {} -> {} bytes, took {}",
+		policy.Describe(),
+		level,
+		this->GetSize(),
+		actualCompressedSize,
+		stdtime::duration_cast<stdtime::milliseconds>(endTime - startTime)
+	);
+
+	if (actualCompressedSize < 0) {
+		delete[] compressedData;
+
+		return nullptr;
+	}
+
+	return new DCXFile(actualCompressedSize, this->fileSize + this->sizeDelta, compressedHeaderLength, compressedData, codec);
+}
+
+bool BNDFile::PackToFile(const std::filesystem::path& dest, const CompressionPolicy& policy, size_t compressedHeaderLength) {
+	if (this->sizeDelta != 0 || this->modified || this->dataFile) {
+		spdlog::info("Relocating the BND in memory");
+
+		Relocate();
+	}
+
+	const auto startTime = stdtime::high_resolution_clock::now();
+
+	const DCXCodec* codec = GetPolicyCodec(policy);
+
+	int level = 0;
+	int actualCompressedSize;
+
+	if (policy.incremental && codec == DCXCodec::Find("DFLT")) {
+		actualCompressedSize = PackIncremental(dest, policy, level, compressedHeaderLength);
+	}
+	else {
+		if (policy.incremental) {
+			spdlog::warn("Incremental packing only works with DFLT, compressing {} from scratch", codec->GetMagic());
+		}
+
+		BlockIndex::Remove(dest);
+
+		actualCompressedSize = DCXFile::CompressToFile(dest, this->backingData, this->GetSize(), codec, policy, level, compressedHeaderLength);
+	}
 
 	const auto endTime = stdtime::high_resolution_clock::now();
 
-	spdlog::info("Compressed the BND, took {}", stdtime::duration_cast<stdtime::milliseconds>(endTime - startTime));
+	spdlog::info(
+		"Compressed the BND to {} with {} (used level {}), {} -> {} bytes, took {}",
+		dest.string(),
+		policy.Describe(),
+		level,
+		this->GetSize(),
+		actualCompressedSize,
+		stdtime::duration_cast<stdtime::milliseconds>(endTime - startTime)
+	);
 
-	return new DCXFile(actualCompressedSize, this->fileSize + this->sizeDelta, compressedHeaderLength, compressedData);
+	return actualCompressedSize >= 0;
 }
 
-const std::vector<const std::string*> BNDFile::GetAllMatbinPaths(bool fullPaths) {
-	std::vector<const std::string*> pathList;
-	pathList.reserve(this->matbinFileMap.size());
+// Reads the payload offsets back from the file table, the incremental blocks get cut on them
+std::vector<uint64_t> BNDFile::ReadPayloadOffsets() {
+	std::vector<uint64_t> offsets;
+	offsets.reserve(this->bindedFileInfos.size());
+
+	WithByteOrder([&](auto& dataView) {
+		for (size_t i = 0; i < this->bindedFileInfos.size(); i++) {
+			dataView.SetOffset(bnd_header_size + i * BindedFileInfo::GetSize() + 24);
 
-	for (const auto& pair : this->matbinFileMap) {
-		if (fullPaths) {
-			pathList.push_back(&pair.second->path);
+			offsets.push_back(dataView.ReadInt64());
 		}
-		else {
-			pathList.push_back(&pair.first);
+	}, this->backingData, this->GetSize());
+
+	return offsets;
+}
+
+int BNDFile::PackIncremental(const std::filesystem::path& dest, const CompressionPolicy& policy, int& usedLevel, size_t compressedHeaderLength) {
+	const int dataLength = this->GetSize();
+	const auto payloadOffsets = this->ReadPayloadOffsets();
+
+	BlockIndex* oldIndex = BlockIndex::Load(dest);
+	DCXFile* oldFile = nullptr;
+
+	if (oldIndex) {
+		oldFile = DCXFile::ReadFile(dest);
+
+		// The index has to describe exactly the file that's there now
+		if (!oldFile || oldFile->GetCodec() != DCXCodec::Find("DFLT") || oldFile->GetCompressedSize() != oldIndex->compressedSize || oldIndex->strategy != policy.strategy) {
+			spdlog::info("The previous build doesn't match its block index, compressing from scratch");
+
+			delete oldIndex;
+			oldIndex = nullptr;
 		}
 	}
 
-	return pathList;
+	// A time budget would pick a slightly different level every time, and then nothing could be reused
+	if (oldIndex && policy.mode == CompressionMode::TimeBudget) {
+		usedLevel = oldIndex->level;
+	}
+	else {
+		usedLevel = ChooseCompressionLevel(policy, this->backingData, dataLength);
+	}
+
+	if (oldIndex && oldIndex->level != usedLevel) {
+		delete oldIndex;
+		oldIndex = nullptr;
+	}
+
+	BlockIndex newIndex;
+	newIndex.level = usedLevel;
+	newIndex.strategy = policy.strategy;
+	newIndex.uncompressedSize = dataLength;
+
+	if (oldIndex && oldIndex->entriesPerBlock > 0) {
+		newIndex.entriesPerBlock = oldIndex->entriesPerBlock;
+	}
+	else {
+		uint64_t payloadsStart = payloadOffsets.empty() ? dataLength : payloadOffsets.front();
+		uint64_t averagePayloadSize = (dataLength - payloadsStart) / std::max<size_t>(1, payloadOffsets.size());
+
+		newIndex.entriesPerBlock = std::max<uint64_t>(1, incremental_block_size / std::max<uint64_t>(1, averagePayloadSize));
+	}
+
+	// The header and file table go in their own block, since the offsets in them change whenever anything is resized
+	std::vector<int> cuts = { 0 };
+
+	for (size_t i = 0; i < payloadOffsets.size(); i += newIndex.entriesPerBlock) {
+		if (payloadOffsets[i] > (uint64_t) cuts.back() && payloadOffsets[i] < (uint64_t) dataLength) {
+			cuts.push_back(payloadOffsets[i]);
+		}
+	}
+
+	cuts.push_back(dataLength);
+
+	std::map<std::pair<uint64_t, uint32_t>, const BlockIndexEntry*> oldBlocks;
+
+	if (oldIndex) {
+		for (const auto& entry : oldIndex->blocks) {
+			if (entry.compressedOffset + entry.compressedLength <= oldIndex->compressedSize) {
+				oldBlocks[{ entry.length, entry.crc }] = &entry;
+			}
+		}
+	}
+
+	std::vector<DeflatedBlock> blocks(cuts.size() - 1);
+	std::vector<uint32_t> blockCrcs(blocks.size());
+	int reusedBlocks = 0;
+
+	for (size_t i = 0; i < blocks.size(); i++) {
+		auto& block = blocks[i];
+
+		block.start = cuts[i];
+		block.length = cuts[i + 1] - cuts[i];
+
+		blockCrcs[i] = crc32(crc32(0, nullptr, 0), this->backingData + block.start, block.length);
+
+		auto oldBlock = oldBlocks.find({ block.length, blockCrcs[i] });
+
+		if (oldBlock != oldBlocks.end()) {
+			const byte* oldData = oldFile->GetCompressedFileData() + oldBlock->second->compressedOffset;
+
+			block.data.assign(oldData, oldData + oldBlock->second->compressedLength);
+			block.adler = oldBlock->second->adler;
+			block.ok = true;
+			block.finished = true;
+
+			reusedBlocks++;
+		}
+	}
+
+	// The old file gets overwritten next, everything needed from it was copied out
+	delete oldFile;
+	delete oldIndex;
+
+	BlockIndex::Remove(dest);
+
+	spdlog::info("Reusing {}/{} compressed blocks from the previous build", reusedBlocks, blocks.size());
+
+	int compressedSize = DCXFile::WriteStreamed(dest, dataLength, DCXCodec::Find("DFLT"), compressedHeaderLength, [&](const ChunkConsumer& consumer) {
+		return CompressDataIndependentBlocks(this->backingData, dataLength, blocks, consumer, usedLevel, policy.strategy);
+	});
+
+	if (compressedSize < 0) {
+		return -1;
+	}
+
+	newIndex.compressedSize = compressedSize;
+	newIndex.blocks.reserve(blocks.size());
+
+	// Right after the 2 byte zlib header
+	uint64_t compressedOffset = 2;
+
+	for (size_t i = 0; i < blocks.size(); i++) {
+		const auto& block = blocks[i];
+
+		newIndex.blocks.push_back({
+			(uint64_t) block.start,
+			(uint64_t) block.length,
+			blockCrcs[i],
+			(uint32_t) block.adler,
+			compressedOffset,
+			(uint64_t) block.compressedLength
+		});
+
+		compressedOffset += block.compressedLength;
+	}
+
+	newIndex.Save(dest);
+
+	return compressedSize;
 }
 
-MatbinFile* BNDFile::GetMatbin(std::string name) {
-	if (this->matbinFileMap.contains(name)) {
-		auto segmentInfo = this->matbinFileMap[name];
+byte* BNDFile::DecompressEntry(const BindedFileInfo& bindedFile) {
+	DCXFile* packed = DCXFile::FromMemory(bindedFile.dataLocation.start, bindedFile.dataLocation.length);
+
+	if (!packed) {
+		spdlog::error("Couldn't read the compressed entry {}", bindedFile.path);
+
+		return nullptr;
+	}
+
+	if (packed->GetUncompressedSize() != bindedFile.uncompressedSize) {
+		spdlog::error("Compressed entry {} claims to inflate to {} bytes instead of {}", bindedFile.path, packed->GetUncompressedSize(), bindedFile.uncompressedSize);
+
+		delete packed;
+
+		return nullptr;
+	}
+
+	byte* decompressed = (byte *) this->arena.allocate(bindedFile.uncompressedSize, 1);
+
+	bool success = packed->DecompressChunked(decompressed, [](const byte* chunk, size_t chunkLength) {
+		return true;
+	});
+
+	delete packed;
+
+	if (!success) {
+		spdlog::error("Couldn't inflate the compressed entry {}", bindedFile.path);
+
+		return nullptr;
+	}
+
+	return decompressed;
+}
 
-		if (!segmentInfo->loaded) {
-			auto offsetInfo = segmentInfo->dataLocation;
+MatbinFile* BNDFile::LoadEntry(const BindedFileInfo& bindedFile) {
+	if (bindedFile.compressed) {
+		byte* decompressed = DecompressEntry(bindedFile);
 
-			segmentInfo->matbin = new MatbinFile(offsetInfo.start, offsetInfo.length);
-			segmentInfo->loaded = true;
+		if (!decompressed) {
+			return nullptr;
 		}
 
-		return segmentInfo->matbin;
+		return new MatbinFile(decompressed, bindedFile.uncompressedSize, true, &this->arena);
+	}
+
+	return new MatbinFile(bindedFile.dataLocation.start, bindedFile.dataLocation.length, false, &this->arena);
+}
+
+MatbinFile* BNDFile::GetMatbin(std::string_view name) {
+	if (const auto entry = this->matbinIndex.Find(name)) {
+		return GetMatbinAt(entry->value);
 	}
 
 	return nullptr;
 }
 
+MatbinFile* BNDFile::GetMatbinByPath(std::string_view path) {
+	int index = this->hashTable.Find(path, [&](int i) -> std::string_view {
+		return this->bindedFileInfos[i].path;
+	});
+
+	if (index < 0) {
+		return nullptr;
+	}
+
+	return GetMatbinAt(index);
+}
+
+MatbinFile* BNDFile::GetMatbinAt(size_t index) {
+	auto segmentInfo = &this->bindedFileInfos[index];
+
+	if (!segmentInfo->loaded) {
+		MatbinFile* matbin = nullptr;
+
+		// A broken matbin only fails itself, the rest of the BND can still be modded
+		try {
+			matbin = LoadEntry(*segmentInfo);
+		}
+		catch (const std::exception& e) {
+			spdlog::error("Couldn't parse {}: {}", segmentInfo->path, e.what());
+		}
+
+		if (!matbin) {
+			return nullptr;
+		}
+
+		// Either the size or the compressed bytes change once it's written
+		if (segmentInfo->compressed) {
+			this->modified = true;
+		}
+
+		segmentInfo->matbin = matbin;
+		segmentInfo->loaded = true;
+	}
+
+	return segmentInfo->matbin;
+}
+
+size_t BNDFile::Prewarm(const std::function<bool(std::string_view name)>& filter, int nThreads) {
+	auto startTime = stdtime::high_resolution_clock::now();
+
+	std::vector<uint32_t> pending;
+	pending.reserve(this->matbinIndex.Size());
+
+	for (const auto& entry : this->matbinIndex) {
+		if (!this->bindedFileInfos[entry.value].loaded && (!filter || filter(entry.name))) {
+			pending.push_back(entry.value);
+		}
+	}
+
+	// Every entry gets its own slot, the workers never touch the BND itself
+	std::vector<MatbinFile*> parsed(pending.size(), nullptr);
+	std::vector<std::string> errors(pending.size());
+
+	Parallel::For(pending.size(), [&](size_t i) {
+		try {
+			parsed[i] = LoadEntry(this->bindedFileInfos[pending[i]]);
+		}
+		catch (const std::exception& e) {
+			errors[i] = e.what();
+		}
+	}, nThreads);
+
+	// Committed in entry order, so the end result doesn't depend on the scheduling
+	size_t loadedCount = 0;
+
+	for (size_t i = 0; i < pending.size(); i++) {
+		auto& segmentInfo = this->bindedFileInfos[pending[i]];
+
+		if (!parsed[i]) {
+			if (!errors[i].empty()) {
+				spdlog::error("Couldn't parse {}: {}", segmentInfo.path, errors[i]);
+			}
+
+			continue;
+		}
+
+		if (segmentInfo.compressed) {
+			this->modified = true;
+		}
+
+		segmentInfo.matbin = parsed[i];
+		segmentInfo.loaded = true;
+
+		loadedCount++;
+	}
+
+	auto endTime = stdtime::high_resolution_clock::now();
+
+	spdlog::info("Prewarmed {}/{} matbins in {}, the arena is at {} bytes, {} bytes of interned names", loadedCount, pending.size(), stdtime::duration_cast<stdtime::milliseconds>(endTime - startTime), this->arena.GetAllocatedSize(), StringInterner::GetStoredSize());
+
+	return loadedCount;
+}
+
 void BNDFile::ApplyMod(const MaterialMod& mod) {
 	const auto changes = mod.GetChanges();
 
 	for (const auto& change : changes) {
 		spdlog::info("Changes: {}", change.first);
 
-		if (this->matbinFileMap.contains(change.first)) {
+		if (auto matbin = this->GetMatbin(change.first)) {
 			spdlog::info("Modding material {}", change.first);
 
-			auto matbin = this->GetMatbin(change.first);
-
 			size_t oldLength = matbin->GetLength();
 
 			matbin->ApplyMod(*change.second);
 
+			this->modified = true;
+
 			if (matbin->WasRelocated()) {
 				spdlog::info("Material {} was relocated", change.first);
 
@@ -1,10 +1,19 @@
 #pragma once
 
+#include <deque>
+#include <functional>
 #include <map>
 #include <string>
+#include <string_view>
 
 #include "binary.h"
+#include "buffer_writer.h"
+#include "compression.h"
 #include "matbin_file.h"
+#include "mapped_file.h"
+#include "name_index.h"
+#include "arena.h"
+#include "bnd_hash_table.h"
 
 #include "material_mod.h"
 
@@ -19,12 +28,19 @@ struct BNDFileHeader {
 	uint64_t version;
 	bool unicode;
 	byte format;
+	byte extended;
+	// 0 if there's no path hash table
+	uint64_t hashTableOffset;
 };
 
 struct BindedFileInfo {
-	std::string path;
+	// Allocated from the BND's arena
+	std::pmr::string path;
 	byte format;
 	bool loaded;
+	// Stored as a DCX inside the BND, until the first GetMatbin the data location holds the compressed bytes
+	bool compressed;
+	uint64_t uncompressedSize;
 
 	union {
 		struct {
@@ -34,19 +50,27 @@ struct BindedFileInfo {
 		MatbinFile* matbin;
 	};
 
+	// A loaded compressed entry compressed again, filled in right before writing
+	std::vector<byte> packedData;
+
 	BindedFileInfo():
 		loaded(false),
 		path(""),
 		format(0),
+		compressed(false),
+		uncompressedSize(0),
 		dataLocation{0, 0} {}
 
-	BindedFileInfo(const std::string& path, byte format, byte* position, int length):
+	BindedFileInfo(std::pmr::string path, byte format, byte* position, int length):
 		loaded(false),
-		path(path),
+		path(std::move(path)),
 		format(format),
+		compressed(false),
+		uncompressedSize(length),
 		dataLocation{position, length} {}
 
-	std::string GetName() const;
+	// A view into the path
+	std::string_view GetName() const;
 
 	std::string GetNameWithParentFolder() const;
 
@@ -54,11 +78,31 @@ struct BindedFileInfo {
 		if (this->loaded) {
 			return this->matbin->GetLength();
 		}
+		else if (this->compressed) {
+			return this->uncompressedSize;
+		}
 		else {
 			return this->dataLocation.length;
 		}
 	}
 
+	// What actually goes in the BND, the DCX for compressed entries
+	uint64_t GetStoredSize() const {
+		if (!this->compressed) {
+			return this->GetFileSize();
+		}
+
+		return this->loaded ? this->packedData.size() : this->dataLocation.length;
+	}
+
+	const byte* GetStoredData() const {
+		if (this->compressed) {
+			return this->loaded ? this->packedData.data() : this->dataLocation.start;
+		}
+
+		return this->loaded ? this->matbin->GetStart() : this->dataLocation.start;
+	}
+
 	static constexpr int GetSize();
 };
 
@@ -116,35 +160,163 @@ private:
 		}
 	};
 
+	// Raw file table entry, kept around only until the payloads are available
+	struct BindedFileRecord {
+		byte flags;
+		uint64_t storedSize;
+		uint64_t uncompressedSize;
+		uint64_t dataOffset;
+		int pathOffset;
+	};
+
+	enum class ParseStage {
+		Header,
+		FileTable,
+		Names,
+		Payloads,
+		Done
+	};
+
+	// Backs the paths, the parsed matbins and their relocated and inflated data, so it has to go last
+	Arena arena;
+
 	byte* backingData;
+	// Set when the backing data is a mapped file rather than a heap buffer
+	MappedFile* backingFile;
+	// The BDF4 of a split BND, the backing data is only the BHF4 then
+	MappedFile* dataFile = nullptr;
 	size_t fileSize;
+	// How far the backing data can grow without a new buffer, a mapped file can't grow at all
+	size_t backingCapacity;
 	std::vector<BindedFileInfo> bindedFileInfos;
-	std::map<std::string, BindedFileInfo*> matbinFileMap;
+	NameIndex matbinIndex;
+	// The one from the file if it had a valid one, built from the paths otherwise
+	BNDHashTable hashTable;
+	// Backing storage for the names of conflicting entries, a deque so the index can keep views into it
+	std::pmr::deque<std::pmr::string> qualifiedNames;
 
 	BNDFileHeader header;
 
 	int sizeDelta = 0;
+	// Set by anything that changes the contents without necessarily changing the size
+	bool modified = false;
+	// Write loaded compressed entries compressed again instead of storing them raw
+	bool keepEntriesCompressed = false;
+
+	ParseStage parseStage = ParseStage::Header;
+	std::vector<BindedFileRecord> pendingRecords;
+	size_t namesEnd = 0;
+	size_t nextPayload = 0;
 
 	BNDFile(byte* backingData, size_t size);
 
-	BindedFileInfo ReadBNDFileHeader(BufferView& dataView, byte format, bool reverseBits);
+	void ReleaseBackingData();
+
+	// Hands function an Accessor made from args in the byte order the header asked for, everything past the header flags goes through here
+	// A view of some data by default, or e.g. a BasicBufferWriter to build something from scratch
+	template<template<Endian> class Accessor = BasicBufferView, typename Function, typename... Args>
+	auto WithByteOrder(Function&& function, Args... args) const {
+		if (this->header.bigEndian) {
+			Accessor<Endian::Big> accessor(args...);
+
+			return function(accessor);
+		}
+
+		Accessor<Endian::Little> accessor(args...);
+
+		return function(accessor);
+	}
+
+	void ReadHeader(BufferView& dataView);
+	template<Endian Order>
+	BindedFileRecord ReadBindedFileRecord(BasicBufferView<Order>& dataView) const;
+
+	// Parses whatever can be parsed from the first availableLength bytes of the backing data
+	// Called repeatedly while the data is still being decompressed, the last call has to cover the whole file
+	void ParseAvailable(size_t availableLength);
+	// Everything after the header
+	template<Endian Order>
+	void ParseTables(BasicBufferView<Order>& dataView, size_t availableLength);
+
+	std::vector<uint64_t> ReadPayloadOffsets();
+
+	// Shifts only the payloads after the first changed entry and patches the file table, false if the buffer is too small or oddly laid out
+	bool RelocateInPlace();
+	// Rebuilds the whole BND into a new buffer
+	void RelocateToNewBuffer();
+
+	// Right after the names, aligned
+	size_t GetHashTableOffset() const;
+	// Size of the header, file table, names and hash table, the payloads come right after
+	size_t GetTablesSize() const;
+	// Writes the header, file table, names and a fresh hash table with the payloads laid out back to back after them
+	// or, when split, after the BDF4 header of the data file
+	template<Endian Order>
+	void WriteTables(BasicBufferWriter<Order>& data, bool split = false) const;
+
+	// Where the payload offsets point into
+	byte* GetPayloadBase() const { return this->dataFile ? this->dataFile->GetData() : this->backingData; }
+	size_t GetPayloadLimit() const { return this->dataFile ? this->dataFile->GetSize() : this->fileSize; }
+
+	// Recompresses the loaded compressed entries, or marks them raw, so their stored sizes are final
+	void PrepareStoredPayloads();
+
+	// nullptr if the entry's DCX is broken, the buffer is from the arena
+	byte* DecompressEntry(const BindedFileInfo& bindedFile);
+	// Parses an entry without touching the BND, safe to call from several threads at once
+	MatbinFile* LoadEntry(const BindedFileInfo& bindedFile);
+	// Loads the entry on first access
+	MatbinFile* GetMatbinAt(size_t index);
+	// Compresses the BND in independent blocks, copying over the ones that didn't change since the last build
+	int PackIncremental(const std::filesystem::path& dest, const CompressionPolicy& policy, int& usedLevel, size_t compressedHeaderLength);
 public:
 	~BNDFile();
 
 	static BNDFile* Parse(const byte* data, size_t dataLength);
+	// Parses a loose BND straight from a mapping of the file
+	static BNDFile* Open(const std::filesystem::path& filePath);
 	void Write(const std::filesystem::path& dest);
 
+	// A BHF4 header file and its BDF4 data file, the payloads are read from the data file as they're needed
+	// Packing or relocating turns it into a single BND4
+	static BNDFile* OpenSplit(const std::filesystem::path& headerPath, const std::filesystem::path& dataPath);
+	void WriteSplit(const std::filesystem::path& headerDest, const std::filesystem::path& dataDest);
+
 	void Relocate();
 
-	DCXFile* Pack(size_t compressedHeaderLength = 8);
+	DCXFile* Pack(const CompressionPolicy& policy = CompressionPolicy(), size_t compressedHeaderLength = 8);
+	// Relocates if needed and compresses straight to a DCX file on disk
+	bool PackToFile(const std::filesystem::path& dest, const CompressionPolicy& policy = CompressionPolicy(), size_t compressedHeaderLength = 8);
 	static BNDFile* Unpack(const DCXFile* file);
 
-	const std::vector<const std::string*> GetAllMatbinPaths(bool fullPaths = false);
+	// Calls back with the name (or the full path) of every matbin in the order they're stored in, without allocating
+	template<typename Callback>
+	void ForEachMatbin(Callback&& callback, bool fullPaths = false) const {
+		for (const auto& entry : this->matbinIndex) {
+			if (fullPaths) {
+				callback(std::string_view(this->bindedFileInfos[entry.value].path));
+			}
+			else {
+				callback(entry.name);
+			}
+		}
+	}
 
-	MatbinFile* GetMatbin(std::string name);
+	size_t MatbinCount() const { return this->matbinIndex.Size(); }
+
+	MatbinFile* GetMatbin(std::string_view name);
+	bool HasMatbin(std::string_view name) const { return this->matbinIndex.Find(name) != nullptr; }
+	// By the full path inside the BND through the path hash table, case and slashes don't matter
+	MatbinFile* GetMatbinByPath(std::string_view path);
+
+	// Parses every matbin the filter accepts (all of them without one) ahead of time, spread over nThreads
+	// The result is the same as calling GetMatbin on each of them in order, returns how many got loaded
+	size_t Prewarm(const std::function<bool(std::string_view name)>& filter = nullptr, int nThreads = 0);
 
 	void ApplyMod(const MaterialMod& mod);
 
+	void SetKeepEntriesCompressed(bool keep) { this->keepEntriesCompressed = keep; }
+
 	const byte* GetData() { return this->backingData; }
 	size_t GetSize() { return this->fileSize + this->sizeDelta; }
 };
\ No newline at end of file
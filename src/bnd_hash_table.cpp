@@ -0,0 +1,332 @@
+#include "bnd_hash_table.h"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <string_view>
+
+#include "utf16.h"
+
+// The table header: the offset to the hashes, the group count and the group and hash sizes
+const size_t hash_table_header_size = 0x10;
+const size_t hash_group_size = 8;
+const size_t path_hash_size = 8;
+// Paths are widened on the stack up to this many code units
+const size_t path_scratch_units = 0x200;
+
+// Every UTF-16 code unit .NET's ToLowerInvariant changes, as runs of every stride-th unit from first to last moving by delta
+// Generated from .NET 8, which is what SoulsFormats and the game's own tools hash with
+struct CaseRange {
+	char16_t first;
+	char16_t last;
+	int delta;
+	int stride;
+};
+
+static constexpr CaseRange lowercase_ranges[] = {
+	{ 0x0041, 0x005A, 32, 1 }, { 0x00C0, 0x00D6, 32, 1 }, { 0x00D8, 0x00DE, 32, 1 }, { 0x0100, 0x012E, 1, 2 },
+	{ 0x0132, 0x0136, 1, 2 }, { 0x0139, 0x0147, 1, 2 }, { 0x014A, 0x0176, 1, 2 }, { 0x0178, 0x0178, -121, 1 },
+	{ 0x0179, 0x017D, 1, 2 }, { 0x0181, 0x0181, 210, 1 }, { 0x0182, 0x0184, 1, 2 }, { 0x0186, 0x0186, 206, 1 },
+	{ 0x0187, 0x0187, 1, 1 }, { 0x0189, 0x018A, 205, 1 }, { 0x018B, 0x018B, 1, 1 }, { 0x018E, 0x018E, 79, 1 },
+	{ 0x018F, 0x018F, 202, 1 }, { 0x0190, 0x0190, 203, 1 }, { 0x0191, 0x0191, 1, 1 }, { 0x0193, 0x0193, 205, 1 },
+	{ 0x0194, 0x0194, 207, 1 }, { 0x0196, 0x0196, 211, 1 }, { 0x0197, 0x0197, 209, 1 }, { 0x0198, 0x0198, 1, 1 },
+	{ 0x019C, 0x019C, 211, 1 }, { 0x019D, 0x019D, 213, 1 }, { 0x019F, 0x019F, 214, 1 }, { 0x01A0, 0x01A4, 1, 2 },
+	{ 0x01A6, 0x01A6, 218, 1 }, { 0x01A7, 0x01A7, 1, 1 }, { 0x01A9, 0x01A9, 218, 1 }, { 0x01AC, 0x01AC, 1, 1 },
+	{ 0x01AE, 0x01AE, 218, 1 }, { 0x01AF, 0x01AF, 1, 1 }, { 0x01B1, 0x01B2, 217, 1 }, { 0x01B3, 0x01B5, 1, 2 },
+	{ 0x01B7, 0x01B7, 219, 1 }, { 0x01B8, 0x01B8, 1, 1 }, { 0x01BC, 0x01BC, 1, 1 }, { 0x01C4, 0x01C4, 2, 1 },
+	{ 0x01C5, 0x01C5, 1, 1 }, { 0x01C7, 0x01C7, 2, 1 }, { 0x01C8, 0x01C8, 1, 1 }, { 0x01CA, 0x01CA, 2, 1 },
+	{ 0x01CB, 0x01DB, 1, 2 }, { 0x01DE, 0x01EE, 1, 2 }, { 0x01F1, 0x01F1, 2, 1 }, { 0x01F2, 0x01F4, 1, 2 },
+	{ 0x01F6, 0x01F6, -97, 1 }, { 0x01F7, 0x01F7, -56, 1 }, { 0x01F8, 0x021E, 1, 2 }, { 0x0220, 0x0220, -130, 1 },
+	{ 0x0222, 0x0232, 1, 2 }, { 0x023A, 0x023A, 10795, 1 }, { 0x023B, 0x023B, 1, 1 }, { 0x023D, 0x023D, -163, 1 },
+	{ 0x023E, 0x023E, 10792, 1 }, { 0x0241, 0x0241, 1, 1 }, { 0x0243, 0x0243, -195, 1 }, { 0x0244, 0x0244, 69, 1 },
+	{ 0x0245, 0x0245, 71, 1 }, { 0x0246, 0x024E, 1, 2 }, { 0x0370, 0x0372, 1, 2 }, { 0x0376, 0x0376, 1, 1 },
+	{ 0x037F, 0x037F, 116, 1 }, { 0x0386, 0x0386, 38, 1 }, { 0x0388, 0x038A, 37, 1 }, { 0x038C, 0x038C, 64, 1 },
+	{ 0x038E, 0x038F, 63, 1 }, { 0x0391, 0x03A1, 32, 1 }, { 0x03A3, 0x03AB, 32, 1 }, { 0x03CF, 0x03CF, 8, 1 },
+	{ 0x03D8, 0x03EE, 1, 2 }, { 0x03F4, 0x03F4, -60, 1 }, { 0x03F7, 0x03F7, 1, 1 }, { 0x03F9, 0x03F9, -7, 1 },
+	{ 0x03FA, 0x03FA, 1, 1 }, { 0x03FD, 0x03FF, -130, 1 }, { 0x0400, 0x040F, 80, 1 }, { 0x0410, 0x042F, 32, 1 },
+	{ 0x0460, 0x0480, 1, 2 }, { 0x048A, 0x04BE, 1, 2 }, { 0x04C0, 0x04C0, 15, 1 }, { 0x04C1, 0x04CD, 1, 2 },
+	{ 0x04D0, 0x052E, 1, 2 }, { 0x0531, 0x0556, 48, 1 }, { 0x10A0, 0x10C5, 7264, 1 }, { 0x10C7, 0x10C7, 7264, 1 },
+	{ 0x10CD, 0x10CD, 7264, 1 }, { 0x13A0, 0x13EF, 38864, 1 }, { 0x13F0, 0x13F5, 8, 1 }, { 0x1C90, 0x1CBA, -3008, 1 },
+	{ 0x1CBD, 0x1CBF, -3008, 1 }, { 0x1E00, 0x1E94, 1, 2 }, { 0x1E9E, 0x1E9E, -7615, 1 }, { 0x1EA0, 0x1EFE, 1, 2 },
+	{ 0x1F08, 0x1F0F, -8, 1 }, { 0x1F18, 0x1F1D, -8, 1 }, { 0x1F28, 0x1F2F, -8, 1 }, { 0x1F38, 0x1F3F, -8, 1 },
+	{ 0x1F48, 0x1F4D, -8, 1 }, { 0x1F59, 0x1F5F, -8, 2 }, { 0x1F68, 0x1F6F, -8, 1 }, { 0x1F88, 0x1F8F, -8, 1 },
+	{ 0x1F98, 0x1F9F, -8, 1 }, { 0x1FA8, 0x1FAF, -8, 1 }, { 0x1FB8, 0x1FB9, -8, 1 }, { 0x1FBA, 0x1FBB, -74, 1 },
+	{ 0x1FBC, 0x1FBC, -9, 1 }, { 0x1FC8, 0x1FCB, -86, 1 }, { 0x1FCC, 0x1FCC, -9, 1 }, { 0x1FD8, 0x1FD9, -8, 1 },
+	{ 0x1FDA, 0x1FDB, -100, 1 }, { 0x1FE8, 0x1FE9, -8, 1 }, { 0x1FEA, 0x1FEB, -112, 1 }, { 0x1FEC, 0x1FEC, -7, 1 },
+	{ 0x1FF8, 0x1FF9, -128, 1 }, { 0x1FFA, 0x1FFB, -126, 1 }, { 0x1FFC, 0x1FFC, -9, 1 }, { 0x2126, 0x2126, -7517, 1 },
+	{ 0x212A, 0x212A, -8383, 1 }, { 0x212B, 0x212B, -8262, 1 }, { 0x2132, 0x2132, 28, 1 }, { 0x2160, 0x216F, 16, 1 },
+	{ 0x2183, 0x2183, 1, 1 }, { 0x24B6, 0x24CF, 26, 1 }, { 0x2C00, 0x2C2F, 48, 1 }, { 0x2C60, 0x2C60, 1, 1 },
+	{ 0x2C62, 0x2C62, -10743, 1 }, { 0x2C63, 0x2C63, -3814, 1 }, { 0x2C64, 0x2C64, -10727, 1 }, { 0x2C67, 0x2C6B, 1, 2 },
+	{ 0x2C6D, 0x2C6D, -10780, 1 }, { 0x2C6E, 0x2C6E, -10749, 1 }, { 0x2C6F, 0x2C6F, -10783, 1 }, { 0x2C70, 0x2C70, -10782, 1 },
+	{ 0x2C72, 0x2C72, 1, 1 }, { 0x2C75, 0x2C75, 1, 1 }, { 0x2C7E, 0x2C7F, -10815, 1 }, { 0x2C80, 0x2CE2, 1, 2 },
+	{ 0x2CEB, 0x2CED, 1, 2 }, { 0x2CF2, 0x2CF2, 1, 1 }, { 0xA640, 0xA66C, 1, 2 }, { 0xA680, 0xA69A, 1, 2 },
+	{ 0xA722, 0xA72E, 1, 2 }, { 0xA732, 0xA76E, 1, 2 }, { 0xA779, 0xA77B, 1, 2 }, { 0xA77D, 0xA77D, -35332, 1 },
+	{ 0xA77E, 0xA786, 1, 2 }, { 0xA78B, 0xA78B, 1, 1 }, { 0xA78D, 0xA78D, -42280, 1 }, { 0xA790, 0xA792, 1, 2 },
+	{ 0xA796, 0xA7A8, 1, 2 }, { 0xA7AA, 0xA7AA, -42308, 1 }, { 0xA7AB, 0xA7AB, -42319, 1 }, { 0xA7AC, 0xA7AC, -42315, 1 },
+	{ 0xA7AD, 0xA7AD, -42305, 1 }, { 0xA7AE, 0xA7AE, -42308, 1 }, { 0xA7B0, 0xA7B0, -42258, 1 }, { 0xA7B1, 0xA7B1, -42282, 1 },
+	{ 0xA7B2, 0xA7B2, -42261, 1 }, { 0xA7B3, 0xA7B3, 928, 1 }, { 0xA7B4, 0xA7C2, 1, 2 }, { 0xA7C4, 0xA7C4, -48, 1 },
+	{ 0xA7C5, 0xA7C5, -42307, 1 }, { 0xA7C6, 0xA7C6, -35384, 1 }, { 0xA7C7, 0xA7C9, 1, 2 }, { 0xA7D0, 0xA7D0, 1, 1 },
+	{ 0xA7D6, 0xA7D8, 1, 2 }, { 0xA7F5, 0xA7F5, 1, 1 }, { 0xFF21, 0xFF3A, 32, 1 },
+};
+
+static bool IsPrime(uint32_t value) {
+	if (value < 2) {
+		return false;
+	}
+
+	for (uint32_t i = 2; i * i <= value; i++) {
+		if (value % i == 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// The smallest prime that gives about 7 paths per group
+static uint32_t GetGroupCount(size_t fileCount) {
+	uint32_t result = fileCount / 7;
+
+	while (!IsPrime(result)) {
+		result++;
+	}
+
+	return result;
+}
+
+static char NormalizePathChar(char c) {
+	if (c == '\\') {
+		return '/';
+	}
+
+	if (c >= 'A' && c <= 'Z') {
+		return c - 'A' + 'a';
+	}
+
+	return c;
+}
+
+static std::string_view TrimPath(std::string_view path) {
+	const char* whitespace = " \t\r\n";
+
+	size_t start = path.find_first_not_of(whitespace);
+
+	if (start == std::string_view::npos) {
+		return {};
+	}
+
+	return path.substr(start, path.find_last_not_of(whitespace) - start + 1);
+}
+
+static constexpr char16_t ToLowerInvariant(char16_t c) {
+	if (c < 0x80) {
+		return c >= u'A' && c <= u'Z' ? c - u'A' + u'a' : c;
+	}
+
+	const CaseRange* range = std::upper_bound(std::begin(lowercase_ranges), std::end(lowercase_ranges), c, [](char16_t value, const CaseRange& r) {
+		return value < r.first;
+	});
+
+	if (range == std::begin(lowercase_ranges)) {
+		return c;
+	}
+
+	range--;
+
+	if (c > range->last || (c - range->first) % range->stride != 0) {
+		return c;
+	}
+
+	return (char16_t) (c + range->delta);
+}
+
+static constexpr char16_t NormalizePathUnit(char16_t c) {
+	return c == u'\\' ? u'/' : ToLowerInvariant(c);
+}
+
+// The same as SoulsFormats, lowercased UTF-16 code units
+static constexpr uint32_t HashCodeUnits(std::u16string_view path) {
+	uint32_t result = 0;
+
+	// Every path is hashed as if it started with a slash
+	if (path.empty() || NormalizePathUnit(path.front()) != u'/') {
+		result = '/';
+	}
+
+	for (char16_t c : path) {
+		result = result * 37 + NormalizePathUnit(c);
+	}
+
+	return result;
+}
+
+// Checked against SoulsFormats' BinderHashTable.ComputeHash
+static_assert(HashCodeUnits(u"N:\\GR\\data\\INTERROOT_win64\\material\\matbin\\Armor\\matxml\\M_Armor_3.matbin") == 0x320DBA8D);
+static_assert(HashCodeUnits(u"N:\\GR\\data\\Tex\\\u00C4_\u0401\u0436_\u03A9_\u0178\u0132_\uFF21.tif") == 0x5BBED8F7);
+
+uint32_t BNDHashTable::ComputeHash(std::string_view path) {
+	path = TrimPath(path);
+
+	// Hashed as UTF-16 like the game does, so non-ASCII paths come out the same
+	const size_t units = UTF16::GetEncodedSize(path) / 2;
+
+	char16_t scratch[path_scratch_units];
+	std::vector<char16_t> longPath;
+	char16_t* wide = scratch;
+
+	if (units > path_scratch_units) {
+		longPath.resize(units);
+		wide = longPath.data();
+	}
+
+	UTF16::Widen(path, (byte *) wide);
+
+	// Without the terminator
+	return HashCodeUnits(std::u16string_view(wide, units - 1));
+}
+
+bool BNDHashTable::PathsMatch(std::string_view a, std::string_view b) {
+	a = TrimPath(a);
+	b = TrimPath(b);
+
+	if (!a.empty() && NormalizePathChar(a.front()) == '/') {
+		a.remove_prefix(1);
+	}
+
+	if (!b.empty() && NormalizePathChar(b.front()) == '/') {
+		b.remove_prefix(1);
+	}
+
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+		return NormalizePathChar(x) == NormalizePathChar(y);
+	});
+}
+
+BNDHashTable BNDHashTable::Build(const std::vector<std::string_view>& paths) {
+	BNDHashTable result;
+
+	const uint32_t groupCount = GetGroupCount(paths.size());
+
+	result.hashes.reserve(paths.size());
+
+	for (size_t i = 0; i < paths.size(); i++) {
+		result.hashes.push_back(PathHash{ComputeHash(paths[i]), (int) i});
+	}
+
+	// Grouped, then by hash, then in entry order so equal hashes don't depend on the sort
+	std::sort(result.hashes.begin(), result.hashes.end(), [&](const PathHash& a, const PathHash& b) {
+		uint32_t groupA = a.hash % groupCount;
+		uint32_t groupB = b.hash % groupCount;
+
+		if (groupA != groupB) {
+			return groupA < groupB;
+		}
+
+		return a.hash != b.hash ? a.hash < b.hash : a.index < b.index;
+	});
+
+	result.groups.resize(groupCount, Group{0, 0});
+
+	for (size_t i = 0; i < result.hashes.size(); i++) {
+		auto& group = result.groups[result.hashes[i].hash % groupCount];
+
+		if (group.length == 0) {
+			group.index = i;
+		}
+
+		group.length++;
+	}
+
+	// Empty groups point at where they would be
+	int nextIndex = 0;
+
+	for (auto& group : result.groups) {
+		if (group.length == 0) {
+			group.index = nextIndex;
+		}
+
+		nextIndex = group.index + group.length;
+	}
+
+	return result;
+}
+
+template<Endian Order>
+BNDHashTable BNDHashTable::Read(BasicBufferView<Order>& data, int fileCount) {
+	BNDHashTable result;
+
+	size_t tableStart = data.GetOffset();
+	uint64_t hashesOffset = data.ReadInt64();
+	uint32_t groupCount = data.ReadInt32();
+
+	data.AssertByte(0x10, "Hash table header size");
+	data.AssertByte(hash_group_size, "Hash group size");
+	data.AssertByte(path_hash_size, "Path hash size");
+	data.AssertByte(0, "Hash table padding");
+
+	if (groupCount == 0 || hashesOffset < tableStart + hash_table_header_size + groupCount * hash_group_size) {
+		throw std::runtime_error(std::format("Invalid hash table: {} groups, hashes at {}", groupCount, hashesOffset));
+	}
+
+	result.groups.reserve(groupCount);
+
+	for (uint32_t i = 0; i < groupCount; i++) {
+		int length = data.ReadInt32();
+		int index = data.ReadInt32();
+
+		if (length < 0 || index < 0 || index + length > fileCount) {
+			throw std::runtime_error(std::format("Hash group {} is out of range: index= {} length= {}", i, index, length));
+		}
+
+		result.groups.push_back(Group{length, index});
+	}
+
+	data.SetOffset(hashesOffset);
+
+	result.hashes.reserve(fileCount);
+
+	for (int i = 0; i < fileCount; i++) {
+		uint32_t hash = data.ReadInt32();
+		int index = data.ReadInt32();
+
+		if (index < 0 || index >= fileCount) {
+			throw std::runtime_error(std::format("Path hash {} points to a file that doesn't exist: {}", i, index));
+		}
+
+		result.hashes.push_back(PathHash{hash, index});
+	}
+
+	return result;
+}
+
+size_t BNDHashTable::GetWrittenSize(size_t fileCount) {
+	return hash_table_header_size + GetGroupCount(fileCount) * hash_group_size + fileCount * path_hash_size;
+}
+
+template<Endian Order>
+void BNDHashTable::Write(BasicBufferWriter<Order>& data) const {
+	auto hashesOffset = data.template ReserveSlot<uint64_t>();
+
+	data.WriteInt32(this->groups.size());
+	data.WriteByte(0x10);
+	data.WriteByte(hash_group_size);
+	data.WriteByte(path_hash_size);
+	data.WriteByte(0);
+
+	for (const auto& group : this->groups) {
+		data.WriteInt32(group.length);
+		data.WriteInt32(group.index);
+	}
+
+	data.FillWithOffset(hashesOffset);
+
+	for (const auto& pathHash : this->hashes) {
+		data.WriteInt32(pathHash.hash);
+		data.WriteInt32(pathHash.index);
+	}
+}
+
+template BNDHashTable BNDHashTable::Read(BufferView& data, int fileCount);
+template BNDHashTable BNDHashTable::Read(BigEndianBufferView& data, int fileCount);
+template void BNDHashTable::Write(BufferWriter& data) const;
+template void BNDHashTable::Write(BigEndianBufferWriter& data) const;
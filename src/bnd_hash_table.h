@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "binary.h"
+#include "buffer_writer.h"
+
+// The path hash table BND4s carry when their extended flag is 4, laid out the same way SoulsFormats writes it
+// Paths are spread over a prime number of groups by hash, each group sorted by hash
+class BNDHashTable {
+public:
+	struct Group {
+		int length;
+		int index;
+	};
+
+	struct PathHash {
+		uint32_t hash;
+		int index;
+	};
+
+private:
+	std::vector<Group> groups;
+	std::vector<PathHash> hashes;
+
+public:
+	// Case insensitive and slash agnostic, "a\B.mtd" and "/A/b.mtd" hash the same
+	// Hashes the UTF-16 code units like SoulsFormats, so non-ASCII paths hash the way the game expects
+	static uint32_t ComputeHash(std::string_view path);
+	// Same rules as the hash
+	static bool PathsMatch(std::string_view a, std::string_view b);
+
+	static BNDHashTable Build(const std::vector<std::string_view>& paths);
+
+	// Throws if the table doesn't describe fileCount entries
+	template<Endian Order>
+	static BNDHashTable Read(BasicBufferView<Order>& data, int fileCount);
+
+	// Size of the table written for fileCount entries
+	static size_t GetWrittenSize(size_t fileCount);
+	// Appended wherever data is, the offsets in the table are relative to the start of data
+	template<Endian Order>
+	void Write(BasicBufferWriter<Order>& data) const;
+
+	bool IsEmpty() const { return this->groups.empty(); }
+
+	// Index of the entry with this path, -1 if there's none
+	// getPath gives the path of an entry by its index, to weed out collisions
+	template<typename PathGetter>
+	int Find(std::string_view path, PathGetter&& getPath) const {
+		if (this->groups.empty()) {
+			return -1;
+		}
+
+		const uint32_t hash = ComputeHash(path);
+		const auto& group = this->groups[hash % this->groups.size()];
+
+		for (int i = group.index; i < group.index + group.length; i++) {
+			if (this->hashes[i].hash == hash && PathsMatch(getPath(this->hashes[i].index), path)) {
+				return this->hashes[i].index;
+			}
+		}
+
+		return -1;
+	}
+};
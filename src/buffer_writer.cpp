@@ -0,0 +1,96 @@
+#include "buffer_writer.h"
+
+#include <algorithm>
+
+#include "utf16.h"
+
+// Small enough that short headers don't waste anything, the growth takes care of the rest
+const size_t writer_min_capacity = 0x100;
+
+template<Endian Order>
+BasicBufferWriter<Order>::BasicBufferWriter(size_t initialCapacity, std::pmr::memory_resource* memory):
+memory(memory) {
+	if (initialCapacity > 0) {
+		Grow(initialCapacity);
+	}
+}
+
+template<Endian Order>
+BasicBufferWriter<Order>::~BasicBufferWriter() {
+	Free();
+}
+
+template<Endian Order>
+byte* BasicBufferWriter<Order>::Allocate(size_t length) {
+	return this->memory ? (byte *) this->memory->allocate(length, 1) : new byte[length];
+}
+
+template<Endian Order>
+void BasicBufferWriter<Order>::Free() {
+	if (!this->data) {
+		return;
+	}
+
+	if (this->memory) {
+		this->memory->deallocate(this->data, this->capacity, 1);
+	}
+	else {
+		delete[] this->data;
+	}
+
+	this->data = nullptr;
+}
+
+template<Endian Order>
+void BasicBufferWriter<Order>::Grow(size_t minimumCapacity) {
+	// Doubling keeps the number of copies logarithmic in the final size
+	const size_t newCapacity = std::max({ minimumCapacity, this->capacity * 2, writer_min_capacity });
+
+	byte* newData = Allocate(newCapacity);
+
+	if (this->size > 0) {
+		memcpy(newData, this->data, this->size);
+	}
+
+	Free();
+
+	this->data = newData;
+	this->capacity = newCapacity;
+}
+
+template<Endian Order>
+void BasicBufferWriter<Order>::Reserve(size_t minimumCapacity) {
+	if (minimumCapacity > this->capacity) {
+		Grow(minimumCapacity);
+	}
+}
+
+template<Endian Order>
+void BasicBufferWriter<Order>::WriteASCII(std::string_view value, bool nullTerminate) {
+	byte* destination = Extend(value.size() + (nullTerminate ? 1 : 0));
+
+	memcpy(destination, value.data(), value.size());
+
+	if (nullTerminate) {
+		destination[value.size()] = '\0';
+	}
+}
+
+template<Endian Order>
+void BasicBufferWriter<Order>::WriteUTF16(std::string_view s) {
+	UTF16::Widen(s, Extend(UTF16::GetEncodedSize(s)));
+}
+
+template<Endian Order>
+byte* BasicBufferWriter<Order>::Release() {
+	byte* result = this->data;
+
+	this->data = nullptr;
+	this->size = 0;
+	this->capacity = 0;
+
+	return result;
+}
+
+template class BasicBufferWriter<Endian::Little>;
+template class BasicBufferWriter<Endian::Big>;
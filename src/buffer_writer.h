@@ -0,0 +1,110 @@
+#pragma once
+
+#include <concepts>
+#include <cstring>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "binary.h"
+
+// Builds a buffer front to back, growing as needed, so nothing has to know the final size up front
+// Offsets that point forward get a slot that's filled in once the thing they point to is written
+template<Endian Order>
+class BasicBufferWriter {
+public:
+	template<std::integral T>
+	struct Slot {
+		size_t offset;
+	};
+
+private:
+	// nullptr for new[], so the buffer can be handed to code that delete[]s it
+	std::pmr::memory_resource* memory;
+	byte* data = nullptr;
+	size_t size = 0;
+	size_t capacity = 0;
+
+	byte* Allocate(size_t length);
+	void Free();
+	void Grow(size_t minimumCapacity);
+
+	// Room for length more bytes, the pointer is where they go
+	byte* Extend(size_t length) {
+		if (this->size + length > this->capacity) {
+			Grow(this->size + length);
+		}
+
+		byte* result = this->data + this->size;
+
+		this->size += length;
+
+		return result;
+	}
+
+	template<std::integral T>
+	static void Store(byte* destination, T value) {
+		if constexpr (Order == Endian::Big) {
+			value = BasicBufferView<Order>::ReverseEndianess(value);
+		}
+
+		memcpy(destination, &value, sizeof(T));
+	}
+
+public:
+	explicit BasicBufferWriter(size_t initialCapacity = 0, std::pmr::memory_resource* memory = nullptr);
+	~BasicBufferWriter();
+
+	BasicBufferWriter(const BasicBufferWriter&) = delete;
+	BasicBufferWriter& operator=(const BasicBufferWriter&) = delete;
+
+	void Reserve(size_t minimumCapacity);
+
+	template<std::integral T>
+	void WriteScalar(T value) { Store(Extend(sizeof(T)), value); }
+
+	void WriteByte(byte value) { WriteScalar<byte>(value); }
+	void WriteBool(bool value) { WriteScalar<byte>(value); }
+	void WriteInt32(int value) { WriteScalar<int>(value); }
+	void WriteInt64(uint64_t value) { WriteScalar<uint64_t>(value); }
+	void WriteFloat(float value) { WriteScalar<uint32_t>(std::bit_cast<uint32_t>(value)); }
+
+	void WriteData(const byte* source, size_t length) { memcpy(Extend(length), source, length); }
+	void WriteZeroes(size_t length) { memset(Extend(length), 0, length); }
+	// Zero padding up to the next multiple of alignment
+	void AlignTo(size_t alignment) { WriteZeroes((alignment - this->size % alignment) % alignment); }
+
+	void WriteASCII(std::string_view value, bool nullTerminate = true);
+	void WriteUTF16(std::string_view s);
+
+	// Zeroes for now, see Fill
+	template<std::integral T>
+	Slot<T> ReserveSlot() {
+		Slot<T> slot{ this->size };
+
+		WriteZeroes(sizeof(T));
+
+		return slot;
+	}
+
+	template<std::integral T>
+	void Fill(Slot<T> slot, T value) { Store(this->data + slot.offset, value); }
+
+	// Points the slot at wherever the writer is now
+	template<std::integral T>
+	void FillWithOffset(Slot<T> slot) { Fill(slot, (T) this->size); }
+
+	size_t GetOffset() const { return this->size; }
+	size_t GetSize() const { return this->size; }
+	size_t GetCapacity() const { return this->capacity; }
+	byte* GetData() { return this->data; }
+	std::span<const byte> GetWritten() const { return std::span<const byte>(this->data, this->size); }
+
+	// Hands the buffer over, it has GetCapacity bytes and comes from memory, or new[] without one
+	// The writer is empty afterwards
+	byte* Release();
+};
+
+using BufferWriter = BasicBufferWriter<Endian::Little>;
+using BigEndianBufferWriter = BasicBufferWriter<Endian::Big>;
@@ -0,0 +1,132 @@
+#include "build_cache.h"
+
+#include <fstream>
+#include <string>
+
+#include "spdlog/spdlog.h"
+
+#include "deflate_backend.h"
+#include "mapped_file.h"
+
+#ifndef PROJECT_VERSION
+	#define PROJECT_VERSION "unknown"
+#endif
+
+namespace fs = std::filesystem;
+
+const uint64_t fnv_offset_basis = 0xCBF29CE484222325;
+const uint64_t fnv_prime = 0x100000001B3;
+
+// FNV-1a, it's only guarding against stale builds, not against anyone forging files
+static void HashBytes(uint64_t& hash, const byte* data, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		hash ^= data[i];
+		hash *= fnv_prime;
+	}
+}
+
+static void HashString(uint64_t& hash, const std::string& s) {
+	uint64_t length = s.size();
+
+	// The length goes in first, so that "ab" + "c" doesn't collide with "a" + "bc"
+	HashBytes(hash, (const byte*) &length, sizeof(length));
+	HashBytes(hash, (const byte*) s.data(), s.size());
+}
+
+static bool HashFile(uint64_t& hash, const fs::path& filePath) {
+	uint64_t length = fs::exists(filePath) ? fs::file_size(filePath) : 0;
+
+	HashBytes(hash, (const byte*) &length, sizeof(length));
+
+	if (length == 0) {
+		return fs::exists(filePath);
+	}
+
+	MappedFile* file = MappedFile::Open(filePath, MappedFile::AccessPattern::Sequential);
+
+	if (!file) {
+		return false;
+	}
+
+	HashBytes(hash, file->GetData(), file->GetSize());
+
+	delete file;
+
+	return true;
+}
+
+static fs::path KeyPath(const fs::path& outputPath) {
+	fs::path result = outputPath;
+	result += ".key";
+
+	return result;
+}
+
+bool BuildCache::ComputeKey(const fs::path& sourcePath, const std::vector<fs::path>& modPaths, const PluginConfig& config, uint64_t& key) {
+	uint64_t hash = fnv_offset_basis;
+
+	HashString(hash, PROJECT_VERSION);
+	HashString(hash, config.compression.Describe());
+	// The one actually selected, an unknown name in the config falls back to the default
+	HashString(hash, DeflateBackend::Current()->GetName());
+	HashString(hash, config.keepEntriesCompressed ? "keep-compressed-entries" : "raw-entries");
+
+	if (!HashFile(hash, sourcePath)) {
+		spdlog::error("Couldn't hash the source archive {}", sourcePath.string());
+
+		return false;
+	}
+
+	for (const auto& modPath : modPaths) {
+		HashString(hash, modPath.filename().string());
+
+		if (!HashFile(hash, modPath)) {
+			spdlog::error("Couldn't hash the mod file {}", modPath.string());
+
+			return false;
+		}
+	}
+
+	key = hash;
+
+	return true;
+}
+
+bool BuildCache::IsUpToDate(const fs::path& outputPath, uint64_t key) {
+	std::error_code error;
+
+	if (!fs::exists(outputPath, error)) {
+		return false;
+	}
+
+	std::ifstream keyFile(KeyPath(outputPath));
+
+	uint64_t storedKey = 0;
+	uint64_t storedSize = 0;
+
+	if (!(keyFile >> std::hex >> storedKey >> std::dec >> storedSize)) {
+		return false;
+	}
+
+	// A truncated or replaced output doesn't count, even if the inputs match
+	return storedKey == key && storedSize == fs::file_size(outputPath, error) && !error;
+}
+
+void BuildCache::Store(const fs::path& outputPath, uint64_t key) {
+	std::error_code error;
+	uint64_t outputSize = fs::file_size(outputPath, error);
+
+	std::ofstream keyFile(KeyPath(outputPath));
+
+	keyFile << std::hex << key << ' ' << std::dec << outputSize << '\n';
+
+	if (error || !keyFile) {
+		spdlog::error("Couldn't write the build key for {}", outputPath.string());
+	}
+}
+
+void BuildCache::Invalidate(const fs::path& outputPath) {
+	std::error_code error;
+
+	fs::remove(KeyPath(outputPath), error);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "config.h"
+
+// Remembers what the built archive was made from, so an unchanged setup doesn't have to rebuild it on every launch
+// The key lives next to the output as <output>.key
+namespace BuildCache {
+	// Hashes the source archive, every mod file, the plugin version and every setting that changes the output bytes
+	// (the compression policy, the deflate backend in use and whether compressed entries stay compressed)
+	bool ComputeKey(const std::filesystem::path& sourcePath, const std::vector<std::filesystem::path>& modPaths, const PluginConfig& config, uint64_t& key);
+
+	// True if the output exists and was built with this exact key
+	bool IsUpToDate(const std::filesystem::path& outputPath, uint64_t key);
+
+	void Store(const std::filesystem::path& outputPath, uint64_t key);
+	void Invalidate(const std::filesystem::path& outputPath);
+}
@@ -1,43 +1,342 @@
 #include "compression.h"
 
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <format>
+
+#include "deflate_backend.h"
+
+const int parallel_block_size = 0x20000;
+const int deflate_dictionary_size = 0x8000;
+const int level_probe_sample_size = 0x100000;
+
+std::string CompressionPolicy::Describe() const {
+	std::string strategyName;
+
+	switch (this->strategy) {
+		case Z_FILTERED: strategyName = "filtered"; break;
+		case Z_HUFFMAN_ONLY: strategyName = "huffman"; break;
+		case Z_RLE: strategyName = "rle"; break;
+		case Z_FIXED: strategyName = "fixed"; break;
+		default: strategyName = "default"; break;
+	}
+
+	const char* incrementalNote = this->incremental ? ", incremental" : "";
+
+	if (this->mode == CompressionMode::TimeBudget) {
+		return std::format("{} best ratio within {} ms, {} strategy{}", this->codec, this->timeBudgetMs, strategyName, incrementalNote);
+	}
+
+	return std::format("{} level {}, {} strategy{}", this->codec, this->level, strategyName, incrementalNote);
+}
 
 int GetMaxCompressedLen(int nLenSrc) {
 	int n16kBlocks = (nLenSrc + 16383) / 16384; // round up any fraction of a block
 	return nLenSrc + 6 + (n16kBlocks*5);
 }
 
-int CompressData(const byte* abSrc, int nLenSrc, byte* abDst, int nLenDst) {
+int CompressData(const byte* abSrc, int nLenSrc, byte* abDst, int nLenDst, int nLevel, int nStrategy) {
+	return DeflateBackend::Current()->Compress(abSrc, nLenSrc, abDst, nLenDst, nLevel, nStrategy);
+}
+
+int ChooseCompressionLevel(const CompressionPolicy& policy, const byte* abSrc, int nLenSrc, int nThreads) {
+	if (policy.mode == CompressionMode::FixedLevel) {
+		return policy.level;
+	}
+
+	if (nThreads <= 0) {
+		nThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// Compress a slice from the middle of the data at decreasing levels, and extrapolate to the whole thing
+	int sampleLength = std::min(nLenSrc, level_probe_sample_size);
+	const byte* sampleStart = abSrc + (nLenSrc - sampleLength) / 2;
+
+	std::vector<byte> sampleOutput(GetMaxCompressedLen(sampleLength) + 64);
+	const DeflateBackend* zlibBackend = DeflateBackend::Find("zlib");
+
+	const double budget = policy.timeBudgetMs;
+	const double scale = sampleLength > 0 ? (double) nLenSrc / sampleLength / std::min(nThreads, std::max(1, nLenSrc / parallel_block_size)) : 0;
+
+	for (int level : {9, 6, 4, 1}) {
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		// The parallel deflate is always zlib, so that's what gets measured
+		zlibBackend->Compress(sampleStart, sampleLength, sampleOutput.data(), sampleOutput.size(), level, policy.strategy);
+
+		const auto endTime = std::chrono::high_resolution_clock::now();
+
+		double projectedMs = std::chrono::duration<double, std::milli>(endTime - startTime).count() * scale;
+
+		if (projectedMs <= budget) {
+			return level;
+		}
+	}
+
+	return 1;
+}
+
+void DeflateBlock(const byte* abSrc, int nLenSrc, int nLevel, int nStrategy, bool independent, DeflatedBlock& block) {
+	bool last = !independent && block.start + block.length == nLenSrc;
+
+	// Sync flush marker and a bit of slack on top of the regular bound
+	block.data.resize(deflateBound(nullptr, block.length) + 16);
+	block.adler = adler32(adler32(0, nullptr, 0), abSrc + block.start, block.length);
+	block.ok = false;
+
 	z_stream zInfo = {0};
-	zInfo.total_in =  zInfo.avail_in =  nLenSrc;
-	zInfo.total_out = zInfo.avail_out = nLenDst;
-	zInfo.next_in = (byte*) abSrc;
-	zInfo.next_out = abDst;
+	zInfo.avail_in = block.length;
+	zInfo.avail_out = block.data.size();
+	zInfo.next_in = (byte*) abSrc + block.start;
+	zInfo.next_out = block.data.data();
 
-	int nErr, nRet = -1;
-	nErr = deflateInit(&zInfo, 0);
+	// Raw deflate, the zlib header and trailer get written once for the whole stream
+	int nErr = deflateInit2(&zInfo, nLevel, Z_DEFLATED, -15, 8, nStrategy);
 	if (nErr == Z_OK) {
-		nErr= deflate(&zInfo, Z_FINISH);
+		// Independent blocks start from an empty window, so they decode the same no matter what comes before them
+		if (block.start > 0 && !independent) {
+			int dictionaryLength = std::min(block.start, deflate_dictionary_size);
 
-		if (nErr == Z_STREAM_END) {
-			nRet = zInfo.total_out;
+			nErr = deflateSetDictionary(&zInfo, abSrc + block.start - dictionaryLength, dictionaryLength);
+		}
+
+		if (nErr == Z_OK) {
+			// Every block but the last ends on a byte boundary without the final block bit, so they can be glued together
+			nErr = deflate(&zInfo, last ? Z_FINISH : independent ? Z_FULL_FLUSH : Z_SYNC_FLUSH);
+
+			if ((last && nErr == Z_STREAM_END) || (!last && nErr == Z_OK && zInfo.avail_in == 0)) {
+				block.data.resize(zInfo.total_out);
+				block.ok = true;
+			}
 		}
 	}
 	deflateEnd(&zInfo);
+}
+
+// Deflates the unfinished blocks on a pool of threads and hands the whole zlib stream to the consumer in order
+int EmitDeflatedBlocks(const byte* abSrc, int nLenSrc, std::vector<DeflatedBlock>& blocks, const ChunkConsumer& consumer, int nLevel, int nStrategy, int nThreads, bool independent) {
+	const int blockCount = blocks.size();
+
+	if (nThreads <= 0) {
+		nThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	nThreads = std::max(1, std::min(nThreads, blockCount));
+
+	// Finished blocks wait for their turn to be written, this caps how many of them are around at once
+	const int blockWindow = nThreads * 2;
+
+	std::mutex blocksMutex;
+	std::condition_variable blockFinished;
+	std::condition_variable blockEmitted;
+	int nextBlock = 0;
+	int emittedBlocks = 0;
+	bool aborted = false;
+
+	auto worker = [&]() {
+		while (true) {
+			int i;
+
+			{
+				std::unique_lock lock(blocksMutex);
+
+				blockEmitted.wait(lock, [&]() { return aborted || nextBlock >= blockCount || nextBlock < emittedBlocks + blockWindow; });
+
+				if (aborted || nextBlock >= blockCount) {
+					return;
+				}
+
+				i = nextBlock++;
+
+				if (blocks[i].finished) {
+					continue;
+				}
+			}
+
+			DeflateBlock(abSrc, nLenSrc, nLevel, nStrategy, independent, blocks[i]);
+
+			{
+				std::lock_guard lock(blocksMutex);
+
+				blocks[i].finished = true;
+			}
+
+			blockFinished.notify_all();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(nThreads);
+
+	for (int i = 0; i < nThreads; i++) {
+		workers.emplace_back(worker);
+	}
+
+	// zlib header, the compression level hint only matters for recompressors
+	byte flevel = nLevel < 2 ? 0 : nLevel < 6 ? 1 : nLevel == 6 || nLevel == Z_DEFAULT_COMPRESSION ? 2 : 3;
+	byte cmf = 0x78;
+	byte flg = flevel << 6;
+
+	if (int check = ((cmf << 8) | flg) % 31) {
+		flg += 31 - check;
+	}
+
+	const byte zlibHeader[2] = { cmf, flg };
 
-	return nRet;
+	bool ok = consumer(zlibHeader, sizeof(zlibHeader));
+	int nRet = sizeof(zlibHeader);
+	uLong adler = adler32(0, nullptr, 0);
+
+	// Blocks go out in order while the later ones are still being deflated
+	for (int i = 0; i < blockCount && ok; i++) {
+		{
+			std::unique_lock lock(blocksMutex);
+
+			blockFinished.wait(lock, [&]() { return blocks[i].finished; });
+		}
+
+		auto& block = blocks[i];
+
+		ok = block.ok && consumer(block.data.data(), block.data.size());
+
+		block.compressedLength = block.data.size();
+		nRet += block.data.size();
+		adler = adler32_combine(adler, block.adler, block.length);
+
+		std::vector<byte>().swap(block.data);
+
+		{
+			std::lock_guard lock(blocksMutex);
+
+			emittedBlocks++;
+			aborted = !ok;
+		}
+
+		blockEmitted.notify_all();
+	}
+
+	// The workers wait on emitted blocks, so they have to be told when the header write already failed and nothing went out
+	if (!ok) {
+		{
+			std::lock_guard lock(blocksMutex);
+
+			aborted = true;
+		}
+
+		blockEmitted.notify_all();
+	}
+
+	for (auto& thread : workers) {
+		thread.join();
+	}
+
+	// Independent blocks never set the final bit, an empty final block with fixed codes closes the stream
+	if (ok && independent) {
+		const byte finalBlock[2] = { 0x03, 0x00 };
+
+		ok = consumer(finalBlock, sizeof(finalBlock));
+		nRet += sizeof(finalBlock);
+	}
+
+	if (ok) {
+		auto trailer = ToBytes((uint32_t) adler);
+
+		ok = consumer(trailer.data(), trailer.size());
+		nRet += trailer.size();
+	}
+
+	return ok ? nRet : -1;
+}
+
+int CompressDataParallel(const byte* abSrc, int nLenSrc, const ChunkConsumer& consumer, int nLevel, int nStrategy, int nThreads) {
+	int blockCount = std::max(1, (nLenSrc + parallel_block_size - 1) / parallel_block_size);
+
+	std::vector<DeflatedBlock> blocks(blockCount);
+
+	for (int i = 0; i < blockCount; i++) {
+		blocks[i].start = i * parallel_block_size;
+		blocks[i].length = std::min(parallel_block_size, nLenSrc - blocks[i].start);
+	}
+
+	return EmitDeflatedBlocks(abSrc, nLenSrc, blocks, consumer, nLevel, nStrategy, nThreads, false);
+}
+
+int CompressDataIndependentBlocks(const byte* abSrc, int nLenSrc, std::vector<DeflatedBlock>& blocks, const ChunkConsumer& consumer, int nLevel, int nStrategy, int nThreads) {
+	int covered = 0;
+
+	for (const auto& block : blocks) {
+		if (block.start != covered || block.length < 0) {
+			return -1;
+		}
+
+		covered += block.length;
+	}
+
+	if (covered != nLenSrc) {
+		return -1;
+	}
+
+	return EmitDeflatedBlocks(abSrc, nLenSrc, blocks, consumer, nLevel, nStrategy, nThreads, true);
 }
 
 int UncompressData(const byte* abSrc, int nLenSrc, byte* abDst, int nLenDst) {
+	return DeflateBackend::Current()->Uncompress(abSrc, nLenSrc, abDst, nLenDst);
+}
+
+int UncompressDataChunked(const byte* abSrc, int nLenSrc, byte* abDst, int nLenDst, int nChunkSize, const ChunkConsumer& consumer) {
+	const DeflateBackend* backend = DeflateBackend::Current();
+
+	// Inflating everything at once and reporting it as one big chunk beats the overlap with a fast enough backend
+	if (abDst && backend->PrefersWholeBuffers()) {
+		int nRet = backend->Uncompress(abSrc, nLenSrc, abDst, nLenDst);
+
+		if (nRet > 0 && !consumer(abDst, nRet)) {
+			return -1;
+		}
+
+		return nRet;
+	}
+
+	byte* ringBuffer = nullptr;
+
+	if (!abDst) {
+		ringBuffer = new byte[nChunkSize];
+	}
+
 	z_stream zInfo = {0};
 	zInfo.total_in = zInfo.avail_in = nLenSrc;
-	zInfo.total_out = zInfo.avail_out = nLenDst;
 	zInfo.next_in = (byte*) abSrc;
-	zInfo.next_out = abDst;
 
 	int nErr, nRet = -1;
 	nErr = inflateInit( &zInfo );
 	if (nErr == Z_OK) {
-		nErr = inflate(&zInfo, Z_FINISH);
+		do {
+			byte* chunkStart = ringBuffer ? ringBuffer : abDst + zInfo.total_out;
+			int chunkLength = ringBuffer ? nChunkSize : std::min(nChunkSize, nLenDst - (int) zInfo.total_out);
+
+			if (chunkLength <= 0) {
+				// Output is full, but the stream says there's more
+				nErr = Z_BUF_ERROR;
+
+				break;
+			}
+
+			zInfo.next_out = chunkStart;
+			zInfo.avail_out = chunkLength;
+
+			nErr = inflate(&zInfo, Z_NO_FLUSH);
+
+			size_t produced = chunkLength - zInfo.avail_out;
+
+			if (produced > 0 && !consumer(chunkStart, produced)) {
+				nErr = Z_DATA_ERROR;
+
+				break;
+			}
+		} while (nErr == Z_OK);
 
 		if (nErr == Z_STREAM_END) {
 			nRet = zInfo.total_out;
@@ -45,5 +344,7 @@ int UncompressData(const byte* abSrc, int nLenSrc, byte* abDst, int nLenDst) {
 	}
 	inflateEnd(&zInfo);
 
+	delete[] ringBuffer;
+
 	return nRet; // -1 or len of output
-}
\ No newline at end of file
+}
@@ -4,11 +4,67 @@
 
 #define ZLIB_WINAPI
 
+#include <functional>
+#include <string>
+#include <vector>
+
 #include "binary.h"
 #include <zlib.h> // Yeah, it errors out, so what?
 
+// Receives the data slice by slice as it gets (de)compressed, return false to stop early
+typedef std::function<bool(const byte* chunk, size_t chunkLength)> ChunkConsumer;
+
+enum class CompressionMode {
+	FixedLevel,
+	TimeBudget
+};
+
+struct CompressionPolicy {
+	// Magic of the DCX codec, see dcx_codec.h
+	std::string codec = "DFLT";
+	CompressionMode mode = CompressionMode::FixedLevel;
+	int level = Z_DEFAULT_COMPRESSION;
+	int strategy = Z_DEFAULT_STRATEGY;
+	// Only used in the TimeBudget mode, the best ratio that's expected to fit in it wins
+	int timeBudgetMs = 0;
+	// Reuse the compressed blocks of the previous build that didn't change, DFLT only
+	bool incremental = false;
+
+	std::string Describe() const;
+};
+
 int GetMaxCompressedLen(int nLenSrc);
 
-int CompressData(const byte* abSrc, int nLenSrc, byte* abDst, int nLenDst);
+int CompressData(const byte* abSrc, int nLenSrc, byte* abDst, int nLenDst, int nLevel = Z_DEFAULT_COMPRESSION, int nStrategy = Z_DEFAULT_STRATEGY);
+
+// Resolves the policy to an actual zlib level, TimeBudget policies get measured on a sample of the input
+int ChooseCompressionLevel(const CompressionPolicy& policy, const byte* abSrc, int nLenSrc, int nThreads = 0);
+
+// pigz style, the input gets split into blocks that are deflated on separate threads
+// Every block uses the 32 KB before it as a preset dictionary, the result is a single regular zlib stream
+// The stream is handed to the consumer in order while the following blocks are still being deflated
+int CompressDataParallel(const byte* abSrc, int nLenSrc, const ChunkConsumer& consumer, int nLevel, int nStrategy = Z_DEFAULT_STRATEGY, int nThreads = 0);
+
+// A slice of the input and its raw deflate data
+struct DeflatedBlock {
+	int start = 0;
+	int length = 0;
+	std::vector<byte> data;
+	// Of the uncompressed slice
+	uLong adler = 0;
+	// Size of the data, kept after the data itself is written out and freed
+	int compressedLength = 0;
+	bool ok = false;
+	// Blocks that are already finished get written out as they are, e.g. when reused from an earlier stream
+	bool finished = false;
+};
+
+// Like CompressDataParallel, but with caller defined blocks that have to cover the input in order
+// Every block starts from an empty window and ends with a full flush, so its data can be spliced into a later stream unchanged
+int CompressDataIndependentBlocks(const byte* abSrc, int nLenSrc, std::vector<DeflatedBlock>& blocks, const ChunkConsumer& consumer, int nLevel, int nStrategy = Z_DEFAULT_STRATEGY, int nThreads = 0);
+
+int UncompressData(const byte* abSrc, int nLenSrc, byte* abDst, int nLenDst);
 
-int UncompressData(const byte* abSrc, int nLenSrc, byte* abDst, int nLenDst);
\ No newline at end of file
+// Inflates at most nChunkSize bytes at a time, handing each slice to the consumer as soon as it's ready
+// With abDst == nullptr a single nChunkSize buffer gets reused for every slice, otherwise the output is written in place
+int UncompressDataChunked(const byte* abSrc, int nLenSrc, byte* abDst, int nLenDst, int nChunkSize, const ChunkConsumer& consumer);
@@ -0,0 +1,125 @@
+#include "config.h"
+
+#include <map>
+
+#include "spdlog/spdlog.h"
+#include "pugixml.hpp"
+
+#include "dcx_codec.h"
+
+namespace fs = std::filesystem;
+
+CompressionPolicy ReadCompressionPolicy(const pugi::xml_node& compressionNode) {
+	static const std::map<std::string, int> strategies = {
+		{ "default", Z_DEFAULT_STRATEGY },
+		{ "filtered", Z_FILTERED },
+		{ "huffman", Z_HUFFMAN_ONLY },
+		{ "rle", Z_RLE },
+		{ "fixed", Z_FIXED },
+	};
+
+	CompressionPolicy policy;
+
+	if (!compressionNode) {
+		return policy;
+	}
+
+	if (auto codecAttribute = compressionNode.attribute("codec")) {
+		std::string codec = codecAttribute.as_string();
+
+		if (DCXCodec::Find(codec)) {
+			policy.codec = codec;
+		}
+		else {
+			spdlog::error("Unknown DCX codec {}, using {}", codec, policy.codec);
+		}
+	}
+
+	if (auto levelAttribute = compressionNode.attribute("level")) {
+		int level = levelAttribute.as_int(Z_DEFAULT_COMPRESSION);
+
+		// zstd goes way past 9, it doesn't care about the strategy though
+		if (level < Z_DEFAULT_COMPRESSION || level > (policy.codec == "ZSTD" ? 22 : Z_BEST_COMPRESSION)) {
+			spdlog::error("Compression level {} is out of range, using the default", level);
+		}
+		else {
+			policy.level = level;
+		}
+	}
+
+	if (auto strategyAttribute = compressionNode.attribute("strategy")) {
+		std::string strategy = strategyAttribute.as_string();
+
+		if (strategies.contains(strategy)) {
+			policy.strategy = strategies.at(strategy);
+		}
+		else {
+			spdlog::error("Unknown compression strategy {}, using the default", strategy);
+		}
+	}
+
+	if (auto budgetAttribute = compressionNode.attribute("budget-ms")) {
+		policy.mode = CompressionMode::TimeBudget;
+		policy.timeBudgetMs = budgetAttribute.as_int(0);
+	}
+
+	if (auto incrementalAttribute = compressionNode.attribute("incremental")) {
+		policy.incremental = incrementalAttribute.as_bool(false);
+	}
+
+	return policy;
+}
+
+PluginConfig PluginConfig::Load(const fs::path& configPath) {
+	PluginConfig config;
+
+	if (!fs::exists(configPath)) {
+		spdlog::info("No config at {}, using the defaults", configPath.string());
+
+		return config;
+	}
+
+	pugi::xml_document configDoc;
+
+	pugi::xml_parse_result result = configDoc.load_file(configPath.c_str());
+	if (!result) {
+		spdlog::error("Failed to load the config at path {}, using the defaults", configPath.string());
+
+		return config;
+	}
+
+	auto root = configDoc.child("glee-config");
+
+	config.compression = ReadCompressionPolicy(root.child("compression"));
+	config.deflateBackend = root.child("compression").attribute("backend").as_string();
+
+	config.keepEntriesCompressed = root.child("binder").attribute("keep-compressed-entries").as_bool(false);
+	config.prewarmThreads = root.child("binder").attribute("prewarm-threads").as_int(-1);
+
+	if (auto cacheNode = root.child("cache")) {
+		config.useBuildCache = cacheNode.attribute("enabled").as_bool(true);
+	}
+
+	std::vector<ArchiveConfig> archives;
+
+	for (const auto& archiveNode : root.child("archives").children("archive")) {
+		ArchiveConfig archive{ archiveNode.attribute("source").as_string(), archiveNode.attribute("output").as_string() };
+
+		if (archive.source.empty() || archive.output.empty()) {
+			spdlog::error("Every archive needs a source and an output, skipping one");
+
+			continue;
+		}
+
+		archives.push_back(archive);
+	}
+
+	// Without any, it's just the base game archive
+	if (!archives.empty()) {
+		config.archives = archives;
+	}
+
+	spdlog::info("Loaded the config, compression: {}, build cache {}, {} archives", config.compression.Describe(), config.useBuildCache ? "on" : "off", config.archives.size());
+
+	return config;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "compression.h"
+
+// One archive to mod, the paths are relative to the plugin
+struct ArchiveConfig {
+	std::filesystem::path source;
+	std::filesystem::path output;
+};
+
+struct PluginConfig {
+	CompressionPolicy compression;
+	// Empty means the fastest one that was built in
+	std::string deflateBackend;
+	// Write compressed BND entries that got modded compressed again instead of raw
+	bool keepEntriesCompressed = false;
+	// Parse the modded matbins up front on this many threads (0 is every core), negative parses them lazily
+	int prewarmThreads = -1;
+	// Keep the built archive between launches and only rebuild it when the inputs change
+	bool useBuildCache = true;
+	// Processed side by side, every mod goes to whichever of them has its target
+	std::vector<ArchiveConfig> archives = {
+		{ "assets/allmaterial.matbinbnd.dcx", "material/allmaterial.matbinbnd.dcx" }
+	};
+
+	// Missing files and attributes keep their defaults
+	static PluginConfig Load(const std::filesystem::path& configPath);
+};
@@ -0,0 +1,207 @@
+#include "dcx_codec.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef GLEE_ZSTD
+	#include <zstd.h>
+#endif
+
+#include "spdlog/spdlog.h"
+
+class DeflateCodec : public DCXCodec {
+public:
+	const char* GetMagic() const override { return "DFLT"; }
+
+	int GetHeaderParameter() const override { return 0x9000000; }
+
+	size_t GetMaxCompressedLen(size_t uncompressedLength) const override {
+		// Every parallel block ends with a sync flush marker on top of what deflate needs anyway
+		return compressBound(uncompressedLength) + (uncompressedLength / 0x20000 + 1) * 16;
+	}
+
+	int CompressStreamed(const byte* source, size_t sourceLength, const CompressionPolicy& policy, int& usedLevel, const ChunkConsumer& consumer) const override {
+		usedLevel = ChooseCompressionLevel(policy, source, sourceLength);
+
+		return CompressDataParallel(source, sourceLength, consumer, usedLevel, policy.strategy);
+	}
+
+	int Uncompress(const byte* source, size_t sourceLength, byte* destination, size_t destinationLength) const override {
+		return UncompressData(source, sourceLength, destination, destinationLength);
+	}
+
+	int UncompressChunked(const byte* source, size_t sourceLength, byte* destination, size_t destinationLength, size_t chunkSize, const ChunkConsumer& consumer) const override {
+		return UncompressDataChunked(source, sourceLength, destination, destinationLength, chunkSize, consumer);
+	}
+};
+
+#ifdef GLEE_ZSTD
+class ZstdCodec : public DCXCodec {
+public:
+	const char* GetMagic() const override { return "ZSTD"; }
+
+	int GetHeaderParameter() const override { return 0x15000000; }
+
+	size_t GetMaxCompressedLen(size_t uncompressedLength) const override {
+		return ZSTD_compressBound(uncompressedLength);
+	}
+
+	int CompressStreamed(const byte* source, size_t sourceLength, const CompressionPolicy& policy, int& usedLevel, const ChunkConsumer& consumer) const override {
+		// zlib's "default" is -1, which zstd would take as one of its fast negative levels
+		usedLevel = policy.level == Z_DEFAULT_COMPRESSION ? ZSTD_CLEVEL_DEFAULT : policy.level;
+
+		if (policy.mode == CompressionMode::TimeBudget) {
+			// zlib levels map roughly to the lower half of the zstd ones, that's where the speed is anyway
+			usedLevel = std::max(1, ChooseCompressionLevel(policy, source, sourceLength) * 2);
+		}
+
+		ZSTD_CCtx* context = ZSTD_createCCtx();
+
+		ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, usedLevel);
+		// Fails quietly if zstd was built without threading
+		ZSTD_CCtx_setParameter(context, ZSTD_c_nbWorkers, std::thread::hardware_concurrency());
+		ZSTD_CCtx_setPledgedSrcSize(context, sourceLength);
+
+		std::vector<byte> outputBuffer(ZSTD_CStreamOutSize());
+		ZSTD_inBuffer input = { source, sourceLength, 0 };
+
+		size_t totalOut = 0;
+		size_t remaining = 0;
+		bool stopped = false;
+
+		do {
+			ZSTD_outBuffer output = { outputBuffer.data(), outputBuffer.size(), 0 };
+
+			remaining = ZSTD_compressStream2(context, &output, &input, ZSTD_e_end);
+
+			if (ZSTD_isError(remaining)) {
+				spdlog::error("ZSTD compression failed: {}", ZSTD_getErrorName(remaining));
+
+				break;
+			}
+
+			totalOut += output.pos;
+
+			if (output.pos > 0 && !consumer(outputBuffer.data(), output.pos)) {
+				stopped = true;
+
+				break;
+			}
+		} while (remaining != 0);
+
+		ZSTD_freeCCtx(context);
+
+		return !stopped && remaining == 0 ? totalOut : -1;
+	}
+
+	int Uncompress(const byte* source, size_t sourceLength, byte* destination, size_t destinationLength) const override {
+		size_t result = ZSTD_decompress(destination, destinationLength, source, sourceLength);
+
+		if (ZSTD_isError(result)) {
+			spdlog::error("ZSTD decompression failed: {}", ZSTD_getErrorName(result));
+
+			return -1;
+		}
+
+		return result;
+	}
+
+	int UncompressChunked(const byte* source, size_t sourceLength, byte* destination, size_t destinationLength, size_t chunkSize, const ChunkConsumer& consumer) const override {
+		std::vector<byte> ringBuffer(destination ? 0 : chunkSize);
+
+		ZSTD_DStream* stream = ZSTD_createDStream();
+		ZSTD_inBuffer input = { source, sourceLength, 0 };
+
+		size_t totalOut = 0;
+		size_t result = 0;
+		// Stopping early is a failure even on the last chunk, the same as for zlib
+		bool consumerFailed = false;
+
+		do {
+			byte* chunkStart = destination ? destination + totalOut : ringBuffer.data();
+			size_t chunkLength = destination ? std::min(chunkSize, destinationLength - totalOut) : chunkSize;
+
+			if (chunkLength == 0) {
+				break;
+			}
+
+			ZSTD_outBuffer output = { chunkStart, chunkLength, 0 };
+
+			result = ZSTD_decompressStream(stream, &output, &input);
+
+			if (ZSTD_isError(result)) {
+				spdlog::error("ZSTD decompression failed: {}", ZSTD_getErrorName(result));
+
+				break;
+			}
+
+			totalOut += output.pos;
+
+			if (output.pos > 0 && !consumer(chunkStart, output.pos)) {
+				consumerFailed = true;
+
+				break;
+			}
+
+			if (output.pos == 0 && input.pos == input.size) {
+				// No progress and nothing left to feed, the frame is truncated
+				break;
+			}
+		} while (result != 0);
+
+		ZSTD_freeDStream(stream);
+
+		return result == 0 && !consumerFailed ? totalOut : -1;
+	}
+};
+#endif
+
+int DCXCodec::Compress(const byte* source, size_t sourceLength, byte* destination, size_t destinationLength, const CompressionPolicy& policy, int& usedLevel) const {
+	size_t written = 0;
+
+	return this->CompressStreamed(source, sourceLength, policy, usedLevel, [&](const byte* chunk, size_t chunkLength) {
+		if (written + chunkLength > destinationLength) {
+			return false;
+		}
+
+		memcpy(destination + written, chunk, chunkLength);
+		written += chunkLength;
+
+		return true;
+	});
+}
+
+std::map<std::string, std::unique_ptr<DCXCodec>>& GetCodecRegistry() {
+	static std::map<std::string, std::unique_ptr<DCXCodec>> registry;
+	static std::once_flag builtinsRegistered;
+
+	std::call_once(builtinsRegistered, []() {
+		registry["DFLT"] = std::make_unique<DeflateCodec>();
+
+#ifdef GLEE_ZSTD
+		registry["ZSTD"] = std::make_unique<ZstdCodec>();
+#endif
+	});
+
+	return registry;
+}
+
+const DCXCodec* DCXCodec::Find(const std::string& magic) {
+	auto& registry = GetCodecRegistry();
+
+	if (registry.contains(magic)) {
+		return registry[magic].get();
+	}
+
+	return nullptr;
+}
+
+const DCXCodec* DCXCodec::Default() {
+	return Find("DFLT");
+}
+
+void DCXCodec::Register(DCXCodec* codec) {
+	GetCodecRegistry()[codec->GetMagic()] = std::unique_ptr<DCXCodec>(codec);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "binary.h"
+#include "compression.h"
+
+// A compression backend for the DCX container, picked by the magic in the DCP header block
+class DCXCodec {
+public:
+	virtual ~DCXCodec() = default;
+
+	// The 4 character magic following "DCP"
+	virtual const char* GetMagic() const = 0;
+
+	// The codec specific value after the 0x20 in the DCP block, FromSoftware stores the compression level in the top byte
+	virtual int GetHeaderParameter() const = 0;
+
+	virtual size_t GetMaxCompressedLen(size_t uncompressedLength) const = 0;
+
+	// Hands the compressed data to the consumer piece by piece, returns the compressed length or -1
+	// usedLevel is set to the level the policy resolved to
+	virtual int CompressStreamed(const byte* source, size_t sourceLength, const CompressionPolicy& policy, int& usedLevel, const ChunkConsumer& consumer) const = 0;
+
+	// Same as above, into a buffer of at least GetMaxCompressedLen bytes
+	int Compress(const byte* source, size_t sourceLength, byte* destination, size_t destinationLength, const CompressionPolicy& policy, int& usedLevel) const;
+
+	// Returns the decompressed length or -1
+	virtual int Uncompress(const byte* source, size_t sourceLength, byte* destination, size_t destinationLength) const = 0;
+
+	virtual int UncompressChunked(const byte* source, size_t sourceLength, byte* destination, size_t destinationLength, size_t chunkSize, const ChunkConsumer& consumer) const = 0;
+
+	// nullptr if no codec with that magic is registered
+	static const DCXCodec* Find(const std::string& magic);
+
+	static const DCXCodec* Default();
+
+	// Takes ownership, replaces any codec with the same magic
+	static void Register(DCXCodec* codec);
+};
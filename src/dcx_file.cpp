@@ -3,47 +3,68 @@
 #include <array>
 #include <cstring>
 #include <fstream>
+#include <sstream>
+#include <vector>
 
 #include "spdlog/spdlog.h"
 
+#include "buffer_writer.h"
 #include "compression.h"
 
-#define RETURN_ERR file.close(); return nullptr;
+#define RETURN_ERR delete file; return nullptr;
 
 namespace fs = std::filesystem;
 
 const size_t dcx_header_size = 0x4C;
+const size_t dcx_write_buffer_size = 0x100000;
 
-DCXFile::DCXFile(size_t compressedSize, size_t uncompressedSize, size_t compressedHeaderLength, byte* fileData):
+DCXFile::DCXFile(size_t compressedSize, size_t uncompressedSize, size_t compressedHeaderLength, byte* fileData, const DCXCodec* codec):
 	compressedSize(compressedSize),
 	uncompressedSize(uncompressedSize),
 	compressedHeaderLength(compressedHeaderLength),
-	compressedFileData(fileData) { }
+	compressedFileData(fileData),
+	codec(codec),
+	backingFile(nullptr),
+	ownsData(true) { }
 
 DCXFile::~DCXFile() {
-	delete[] this->compressedFileData;
+	if (this->backingFile) {
+		delete this->backingFile;
+	}
+	else if (this->ownsData) {
+		delete[] this->compressedFileData;
+	}
 }
 
 DCXFile* DCXFile::ReadFile(const fs::path& filePath) {
-	std::basic_ifstream<char> file(filePath, std::ios::binary);
+	// The compressed payload is used straight from the page cache, no copies
+	MappedFile* file = MappedFile::Open(filePath, MappedFile::AccessPattern::Sequential);
 
-	if (!file.is_open()) {
-		spdlog::error("Cannot open file: " + filePath.string());
+	if (!file) {
+		return nullptr;
+	}
+
+	DCXFile* result = FromMemory(file->GetData(), file->GetSize());
+
+	if (!result) {
+		spdlog::error("Unable to read the DCX file: " + filePath.string());
 
 		RETURN_ERR;
 	}
 
-	byte header[dcx_header_size] = {0};
-	file.read((char *) header, dcx_header_size);
+	result->backingFile = file;
 
+	return result;
+}
 
-	if (!file.good()) {
-		spdlog::error("Unable to read header : " + filePath.string());
+DCXFile* DCXFile::FromMemory(const byte* data, size_t dataLength) {
+	if (dataLength < dcx_header_size) {
+		spdlog::error("Unable to read the DCX header, only {} bytes", dataLength);
 
-		RETURN_ERR;
+		return nullptr;
 	}
 
-	BufferView headerView(header, dcx_header_size);
+	BigEndianBufferView headerView(const_cast<byte *>(data), dcx_header_size);
 
 	try {
 		headerView.AssertASCII("DCX", 4, "Magic Value");
@@ -58,29 +79,36 @@ DCXFile* DCXFile::ReadFile(const fs::path& filePath) {
 		int compressedSize = headerView.ReadInt32();
 
 		headerView.AssertASCII("DCP", 4, "DCP magic");
-		headerView.AssertASCII("DFLT", "DFLT magic");
+
+		std::string codecMagic = headerView.ReadASCII(4);
+		const DCXCodec* codec = DCXCodec::Find(codecMagic);
+
+		if (!codec) {
+			throw std::runtime_error(std::format("Unsupported DCX compression: {}", codecMagic));
+		}
+
 		headerView.AssertInt32(0x20, "");
-		headerView.AssertInt32(0x9000000, "");
+		// Compression level and such, we don't need it to decompress
+		headerView.Skip<int>();
 		headerView.AssertInt32(0, "");
 		headerView.AssertInt32(0, "");
 		headerView.AssertInt32(0, "");
 		headerView.AssertInt32(0x00010100, "");
-		headerView.AssertASCII("DCA", "DCA magic");
+		headerView.AssertASCII("DCA", 4, "DCA magic");
 
 		int compressedHeaderLength = headerView.ReadInt32();
 
-		byte* fileData = new byte[compressedSize];
+		if (compressedSize < 0 || uncompressedSize < 0 || dcx_header_size + compressedSize > dataLength) {
+			throw std::runtime_error(std::format("Compressed size {} doesn't fit in the file", compressedSize));
+		}
 
-		file.read((char *) fileData, compressedSize);
+		DCXFile* result = new DCXFile(compressedSize, uncompressedSize, compressedHeaderLength, const_cast<byte *>(data) + dcx_header_size, codec);
+		result->ownsData = false;
 
-		file.close();
-
-		return new DCXFile(compressedSize, uncompressedSize, compressedHeaderLength, fileData);
-	} catch (std::runtime_error e) {
+		return result;
+	} catch (const std::runtime_error& e) {
 		spdlog::error(e.what());
 
-		file.close();
-
 		return nullptr;
 	}
 }
@@ -88,7 +116,7 @@ DCXFile* DCXFile::ReadFile(const fs::path& filePath) {
 byte* DCXFile::Decompress(size_t& decompressedSize) const {
 	byte* buffer = new byte[this->uncompressedSize];
 
-	int result = UncompressData(this->compressedFileData, this->compressedSize, buffer, this->uncompressedSize);
+	int result = this->codec->Uncompress(this->compressedFileData, this->compressedSize, buffer, this->uncompressedSize);
 
 	if (result < 0) {
 		delete[] buffer;
@@ -102,36 +130,118 @@ byte* DCXFile::Decompress(size_t& decompressedSize) const {
 	}
 }
 
-void DCXFile::WriteFile(const fs::path& filePath) {
-	std::ofstream file(filePath, std::ios::binary);
+bool DCXFile::DecompressChunked(byte* destination, const ChunkConsumer& consumer, size_t chunkSize) const {
+	int result = this->codec->UncompressChunked(this->compressedFileData, this->compressedSize, destination, this->uncompressedSize, chunkSize, consumer);
+
+	return result >= 0 && (size_t) result == this->uncompressedSize;
+}
+
+// Gives back where the compressed size went, for writers that only know it at the end
+static BigEndianBufferWriter::Slot<uint32_t> WriteDCXHeader(BigEndianBufferWriter& header, const DCXCodec* codec, size_t uncompressedSize, size_t compressedSize, size_t compressedHeaderLength) {
+	header.WriteASCII("DCX");
+	header.WriteInt32(0x11000);
+	header.WriteInt32(0x18);
+	header.WriteInt32(0x24);
+	header.WriteInt32(0x44);
+	header.WriteInt32(0x4C);
+	header.WriteASCII("DCS");
+	header.WriteScalar<uint32_t>(uncompressedSize);
+	auto compressedSizeSlot = header.ReserveSlot<uint32_t>();
+	header.Fill(compressedSizeSlot, (uint32_t) compressedSize);
+	header.WriteASCII("DCP");
+	header.WriteASCII(codec->GetMagic(), false);
+	header.WriteInt32(0x20);
+	header.WriteInt32(codec->GetHeaderParameter());
+	header.WriteInt32(0);
+	header.WriteInt32(0);
+	header.WriteInt32(0);
+	header.WriteInt32(0x00010100);
+	header.WriteASCII("DCA");
+	header.WriteScalar<uint32_t>(compressedHeaderLength);
+
+	return compressedSizeSlot;
+}
 
+std::vector<byte> DCXFile::Serialize() const {
+	BigEndianBufferWriter header(dcx_header_size);
+
+	WriteDCXHeader(header, this->codec, this->uncompressedSize, this->compressedSize, this->compressedHeaderLength);
+
+	std::vector<byte> result;
+	result.reserve(header.GetSize() + this->compressedSize);
+	result.insert(result.end(), header.GetData(), header.GetData() + header.GetSize());
+	result.insert(result.end(), this->compressedFileData, this->compressedFileData + this->compressedSize);
+
+	return result;
+}
+
+void DCXFile::WriteFile(const fs::path& filePath) {
 	const auto startTime = std::chrono::high_resolution_clock::now();
 
-	file << ToBytes<4>("DCX");
-	file << ToBytes(0x11000);
-	file << ToBytes(0x18);
-	file << ToBytes(0x24);
-	file << ToBytes(0x44);
-	file << ToBytes(0x4C);
-	file << ToBytes<4>("DCS");
-	file << ToBytes((uint32_t) this->uncompressedSize);
-	file << ToBytes((uint32_t) this->compressedSize);
-	file << ToBytes<4>("DCP");
-	file << ToBytes<4>("DFLT");
-	file << ToBytes(0x20);
-	file << ToBytes(0x9000000);
-	file << ToBytes(0);
-	file << ToBytes(0);
-	file << ToBytes(0);
-	file << ToBytes(0x00010100);
-	file << ToBytes<4>("DCA");
-	file << ToBytes((uint32_t) this->compressedHeaderLength);
-
-	file.write((char *) this->compressedFileData, this->compressedSize);
+	BigEndianBufferWriter header(dcx_header_size);
 
-	file.close();
+	WriteDCXHeader(header, this->codec, this->uncompressedSize, this->compressedSize, this->compressedHeaderLength);
+
+	// The payload goes out straight from where it is, behind the header
+	if (!DumpToFile(filePath, { header.GetWritten(), std::span<const byte>(this->compressedFileData, this->compressedSize) })) {
+		spdlog::error("Couldn't write the DCX to {}", filePath.string());
+
+		return;
+	}
 
 	const auto endTime = std::chrono::high_resolution_clock::now();
 
 	spdlog::info("Wrote the file, took {}", std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime));
-}
\ No newline at end of file
+}
+
+int DCXFile::CompressToFile(const fs::path& filePath, const byte* data, size_t dataLength, const DCXCodec* codec, const CompressionPolicy& policy, int& usedLevel, size_t compressedHeaderLength) {
+	return WriteStreamed(filePath, dataLength, codec, compressedHeaderLength, [&](const ChunkConsumer& consumer) {
+		return codec->CompressStreamed(data, dataLength, policy, usedLevel, consumer);
+	});
+}
+
+int DCXFile::WriteStreamed(const fs::path& filePath, size_t uncompressedLength, const DCXCodec* codec, size_t compressedHeaderLength, const StreamedPayload& payload) {
+	std::vector<char> streamBuffer(dcx_write_buffer_size);
+
+	std::ofstream file;
+	file.rdbuf()->pubsetbuf(streamBuffer.data(), streamBuffer.size());
+	file.open(filePath, std::ios::binary);
+
+	if (!file.is_open()) {
+		spdlog::error("Cannot open file: " + filePath.string());
+
+		return -1;
+	}
+
+	// The compressed size isn't known yet, it gets filled in and the header written again at the end
+	BigEndianBufferWriter header(dcx_header_size);
+	auto compressedSizeSlot = WriteDCXHeader(header, codec, uncompressedLength, 0, compressedHeaderLength);
+
+	file.write((const char *) header.GetData(), header.GetSize());
+
+	int compressedSize = payload([&](const byte* chunk, size_t chunkLength) {
+		file.write((char *) chunk, chunkLength);
+
+		return file.good();
+	});
+
+	if (compressedSize >= 0) {
+		header.Fill(compressedSizeSlot, (uint32_t) compressedSize);
+
+		file.seekp(0);
+		file.write((const char *) header.GetData(), header.GetSize());
+	}
+
+	file.close();
+
+	if (compressedSize < 0 || !file) {
+		spdlog::error("Couldn't write the compressed file {}", filePath.string());
+
+		std::error_code removeError;
+		fs::remove(filePath, removeError);
+
+		return -1;
+	}
+
+	return compressedSize;
+}
@@ -4,9 +4,14 @@
 #include <filesystem>
 
 #include "binary.h"
+#include "compression.h"
+#include "dcx_codec.h"
+#include "mapped_file.h"
 
 class BNDFile;
 
+const size_t dcx_inflate_chunk_size = 0x40000;
+
 class DCXFile {
 private:
 	size_t compressedSize;
@@ -15,18 +20,45 @@ private:
 
 	byte* compressedFileData;
 
+	const DCXCodec* codec;
+
+	// Set when the compressed data lives in a mapping rather than on the heap
+	MappedFile* backingFile;
+	// Off for DCX files that only borrow their data, see FromMemory
+	bool ownsData;
+
 public:
-	DCXFile(size_t compressedSize, size_t uncompressedSize, size_t compressedHeaderLength, byte* fileData);
+	DCXFile(size_t compressedSize, size_t uncompressedSize, size_t compressedHeaderLength, byte* fileData, const DCXCodec* codec);
 	~DCXFile();
 	
 	static DCXFile* ReadFile(const std::filesystem::path& filePath);
 
+	// Reads a DCX that's embedded in a bigger buffer, the data has to outlive the result
+	static DCXFile* FromMemory(const byte* data, size_t dataLength);
+
 	byte* Decompress(size_t& decompressedSize) const;
 
+	// Decompresses into destination (or a reused chunk buffer when it's null) and reports every chunk to the consumer
+	bool DecompressChunked(byte* destination, const ChunkConsumer& consumer, size_t chunkSize = dcx_inflate_chunk_size) const;
+
 	void WriteFile(const std::filesystem::path& filePath);
 
-	size_t GetCompressedSize() { return this->compressedSize; }
-	size_t GetUncompressedSize() { return this->uncompressedSize; }
+	// The whole file, header included
+	std::vector<byte> Serialize() const;
+
+	// Compresses data straight into a new DCX file without holding the compressed result in memory
+	// Returns the compressed size or -1, a failed write doesn't leave a partial file behind
+	static int CompressToFile(const std::filesystem::path& filePath, const byte* data, size_t dataLength, const DCXCodec* codec, const CompressionPolicy& policy, int& usedLevel, size_t compressedHeaderLength = 8);
+
+	// Writes the compressed stream into the consumer it's given and returns its length, or -1
+	typedef std::function<int(const ChunkConsumer& consumer)> StreamedPayload;
+
+	// Same as CompressToFile, for payloads that were compressed some other way
+	static int WriteStreamed(const std::filesystem::path& filePath, size_t uncompressedLength, const DCXCodec* codec, size_t compressedHeaderLength, const StreamedPayload& payload);
+
+	size_t GetCompressedSize() const { return this->compressedSize; }
+	size_t GetUncompressedSize() const { return this->uncompressedSize; }
 	size_t GetCompressedHeaderLength() { return this->compressedHeaderLength; }
 	const byte* GetCompressedFileData() { return this->compressedFileData; }
+	const DCXCodec* GetCodec() const { return this->codec; }
 };
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "deflate_backend.h"
+
+#include <atomic>
+
+#ifdef GLEE_LIBDEFLATE
+	#include <libdeflate.h>
+#endif
+
+#include "spdlog/spdlog.h"
+
+#include "compression.h"
+
+class ZlibBackend : public DeflateBackend {
+public:
+	const char* GetName() const override { return "zlib"; }
+
+	int Compress(const byte* source, int sourceLength, byte* destination, int destinationLength, int level, int strategy) const override {
+		z_stream zInfo = {0};
+		zInfo.total_in =  zInfo.avail_in =  sourceLength;
+		zInfo.total_out = zInfo.avail_out = destinationLength;
+		zInfo.next_in = (byte*) source;
+		zInfo.next_out = destination;
+
+		int nErr, nRet = -1;
+		nErr = deflateInit2(&zInfo, level, Z_DEFLATED, MAX_WBITS, 8, strategy);
+		if (nErr == Z_OK) {
+			nErr = deflate(&zInfo, Z_FINISH);
+
+			if (nErr == Z_STREAM_END) {
+				nRet = zInfo.total_out;
+			}
+		}
+		deflateEnd(&zInfo);
+
+		return nRet;
+	}
+
+	int Uncompress(const byte* source, int sourceLength, byte* destination, int destinationLength) const override {
+		z_stream zInfo = {0};
+		zInfo.total_in = zInfo.avail_in = sourceLength;
+		zInfo.total_out = zInfo.avail_out = destinationLength;
+		zInfo.next_in = (byte*) source;
+		zInfo.next_out = destination;
+
+		int nErr, nRet = -1;
+		nErr = inflateInit( &zInfo );
+		if (nErr == Z_OK) {
+			nErr = inflate(&zInfo, Z_FINISH);
+
+			if (nErr == Z_STREAM_END) {
+				nRet = zInfo.total_out;
+			}
+		}
+		inflateEnd(&zInfo);
+
+		return nRet; // -1 or len of output
+	}
+
+	bool PrefersWholeBuffers() const override { return false; }
+};
+
+#ifdef GLEE_LIBDEFLATE
+class LibdeflateBackend : public DeflateBackend {
+public:
+	const char* GetName() const override { return "libdeflate"; }
+
+	int Compress(const byte* source, int sourceLength, byte* destination, int destinationLength, int level, int strategy) const override {
+		// libdeflate goes up to 12 and has no strategies, zlib's "default" is -1
+		libdeflate_compressor* compressor = libdeflate_alloc_compressor(level == Z_DEFAULT_COMPRESSION ? 6 : level);
+
+		if (!compressor) {
+			return -1;
+		}
+
+		size_t result = libdeflate_zlib_compress(compressor, source, sourceLength, destination, destinationLength);
+
+		libdeflate_free_compressor(compressor);
+
+		return result > 0 ? result : -1;
+	}
+
+	int Uncompress(const byte* source, int sourceLength, byte* destination, int destinationLength) const override {
+		libdeflate_decompressor* decompressor = libdeflate_alloc_decompressor();
+
+		if (!decompressor) {
+			return -1;
+		}
+
+		size_t actualLength = 0;
+		libdeflate_result result = libdeflate_zlib_decompress(decompressor, source, sourceLength, destination, destinationLength, &actualLength);
+
+		libdeflate_free_decompressor(decompressor);
+
+		if (result != LIBDEFLATE_SUCCESS) {
+			spdlog::error("libdeflate couldn't decompress the data, error {}", (int) result);
+
+			return -1;
+		}
+
+		return actualLength;
+	}
+
+	bool PrefersWholeBuffers() const override { return true; }
+};
+#endif
+
+std::vector<const DeflateBackend*> DeflateBackend::All() {
+	static const ZlibBackend zlibBackend;
+
+#ifdef GLEE_LIBDEFLATE
+	static const LibdeflateBackend libdeflateBackend;
+
+	return { &libdeflateBackend, &zlibBackend };
+#else
+	return { &zlibBackend };
+#endif
+}
+
+static std::atomic<const DeflateBackend*> currentBackend = nullptr;
+
+const DeflateBackend* DeflateBackend::Find(const std::string& name) {
+	for (const DeflateBackend* backend : All()) {
+		if (name == backend->GetName()) {
+			return backend;
+		}
+	}
+
+	return nullptr;
+}
+
+const DeflateBackend* DeflateBackend::Current() {
+	const DeflateBackend* backend = currentBackend.load();
+
+	// The list goes from the fastest one
+	return backend ? backend : All().front();
+}
+
+bool DeflateBackend::Select(const std::string& name) {
+	const DeflateBackend* backend = Find(name);
+
+	if (!backend) {
+		spdlog::error("Deflate backend {} isn't available, staying with {}", name, Current()->GetName());
+
+		return false;
+	}
+
+	currentBackend = backend;
+
+	return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "binary.h"
+
+// The library doing the whole buffer zlib (de)compression behind compression.h
+// The parallel and incremental deflate always go through zlib, they need preset dictionaries and flushes that libdeflate doesn't have
+class DeflateBackend {
+public:
+	virtual ~DeflateBackend() = default;
+
+	virtual const char* GetName() const = 0;
+
+	// Both work on complete zlib streams and return the output length or -1
+	virtual int Compress(const byte* source, int sourceLength, byte* destination, int destinationLength, int level, int strategy) const = 0;
+	virtual int Uncompress(const byte* source, int sourceLength, byte* destination, int destinationLength) const = 0;
+
+	// Whole buffer inflate is fast enough to beat overlapping a chunked inflate with parsing
+	virtual bool PrefersWholeBuffers() const = 0;
+
+	// nullptr if it wasn't built in
+	static const DeflateBackend* Find(const std::string& name);
+
+	// The one CompressData and UncompressData go through, the fastest one that was built in unless something else was selected
+	static const DeflateBackend* Current();
+
+	// Returns false and keeps the current backend if there's no such backend
+	static bool Select(const std::string& name);
+
+	static std::vector<const DeflateBackend*> All();
+};
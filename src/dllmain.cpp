@@ -13,6 +13,7 @@
 	#define DLL_PROCESS_DETACH 1
 #endif
 
+#include <algorithm>
 #include <fstream>
 #include <filesystem>
 #include <chrono>
@@ -25,8 +26,14 @@
 #include "matbin_file.h"
 #include "bnd_file.h"
 #include "logging.h"
+#include "config.h"
+#include "build_cache.h"
+#include "block_index.h"
+#include "deflate_backend.h"
+#include "parallel.h"
 
 namespace fs = std::filesystem;
+namespace stdtime = std::chrono;
 
 fs::path GetLibraryDir(HINSTANCE instanceID) {
 	fs::path result;
@@ -45,74 +52,159 @@ fs::path GetLibraryDir(HINSTANCE instanceID) {
 }
 
 fs::path pluginDir;
+PluginConfig config;
 
-void LoadXMLs() {
-	const auto sourceDCXpath = pluginDir / "assets" / "allmaterial.matbinbnd.dcx";
+std::vector<fs::path> FindModFiles(const fs::path& xmlSourceDir) {
+	std::vector<fs::path> result;
 
-	spdlog::info("Starting XML modding");
+	if (fs::exists(xmlSourceDir) && fs::is_directory(xmlSourceDir)) {
+		for (const auto& file : fs::directory_iterator(xmlSourceDir)) {
+			const auto& filePath = file.path();
+
+			if (filePath.extension() == ".xml") {
+				result.push_back(filePath);
+			}
+		}
+	}
+	else {
+		if (!fs::exists(xmlSourceDir)) {
+			spdlog::error("Directory {} doesn't exist!", xmlSourceDir.string());
+		}
+		else {
+			spdlog::error("{} isn't a directory!", xmlSourceDir.string());
+		}
+	}
+
+	// Directory order isn't guaranteed, this keeps both the mod order and the build key stable
+	std::sort(result.begin(), result.end());
+
+	return result;
+}
+
+// What happened to one archive, filled in by the thread that built it
+struct ArchiveResult {
+	// False if the cached build was reused, foundTargets is empty then
+	bool unpacked = false;
+	// In the order of the mod's changes
+	std::vector<bool> foundTargets;
+};
+
+void BuildArchive(const ArchiveConfig& archive, const std::vector<fs::path>& modFiles, const MaterialMod& mod, ArchiveResult& result) {
+	const auto sourceDCXpath = pluginDir / archive.source;
+	const auto newDCXFilePath = pluginDir / archive.output;
+
+	uint64_t buildKey = 0;
+	bool hasBuildKey = config.useBuildCache && BuildCache::ComputeKey(sourceDCXpath, modFiles, config, buildKey);
+
+	if (hasBuildKey && BuildCache::IsUpToDate(newDCXFilePath, buildKey)) {
+		spdlog::info("Nothing changed since the last build, reusing {}", newDCXFilePath.string());
+
+		return;
+	}
+
+	// Whatever is there now is about to be overwritten
+	BuildCache::Invalidate(newDCXFilePath);
 
 	auto sourceMatFile = DCXFile::ReadFile(sourceDCXpath);
 
 	if (!sourceMatFile) {
-		spdlog::error("Couldn't read the source material file");
+		spdlog::error("Couldn't read the source material file {}", sourceDCXpath.string());
 
 		return;
 	}
 
 	auto bnd = BNDFile::Unpack(sourceMatFile);
 
+	// The compressed data isn't needed anymore, no reason to keep it around while modding
+	delete sourceMatFile;
+
 	if (!bnd) {
-		spdlog::error("Not good - BND");
+		spdlog::error("Not good - BND {}", sourceDCXpath.string());
 
 		return;
 	}
 
-	MaterialMod mod;
+	result.unpacked = true;
 
-	auto xmlSourceDir = pluginDir / "recolors";
+	for (const auto& change : mod.GetChanges()) {
+		result.foundTargets.push_back(bnd->HasMatbin(change.first));
+	}
 
-	if (fs::exists(xmlSourceDir) && fs::is_directory(xmlSourceDir)) {
-		for (const auto& file : fs::directory_iterator(xmlSourceDir)) {
-			const auto& filePath = file.path();
+	bnd->SetKeepEntriesCompressed(config.keepEntriesCompressed);
 
-			if (filePath.extension() == ".xml") {
-				pugi::xml_document modDoc;
+	if (config.prewarmThreads >= 0) {
+		const auto& changes = mod.GetChanges();
 
-				pugi::xml_parse_result result = modDoc.load_file(filePath.c_str());
-				if (!result) {
-					spdlog::error("Failed to load the XML at path {}", filePath.string());
+		bnd->Prewarm([&](std::string_view name) {
+			return changes.find(std::string(name)) != changes.end();
+		}, config.prewarmThreads);
+	}
 
-					continue;
-				}
-				else {
-					spdlog::info("Loaded the XML at path {}", filePath.string());
-				}
+	// Only the changes with a target in this archive do anything
+	bnd->ApplyMod(mod);
 
-				mod.AddMod(modDoc);
-			}
-		}
+	if (!bnd->PackToFile(newDCXFilePath, config.compression)) {
+		spdlog::error("Couldn't write the modded material file {}", newDCXFilePath.string());
 	}
-	else {
-		if (!fs::exists(xmlSourceDir)) {
-			spdlog::error("Directory {} doesn't exist!", xmlSourceDir.string());
+	else if (hasBuildKey) {
+		BuildCache::Store(newDCXFilePath, buildKey);
+	}
+
+	delete bnd;
+}
+
+void LoadXMLs() {
+	const auto startTime = stdtime::high_resolution_clock::now();
+
+	spdlog::info("Starting XML modding");
+
+	const auto modFiles = FindModFiles(pluginDir / "recolors");
+
+	MaterialMod mod;
+
+	for (const auto& filePath : modFiles) {
+		pugi::xml_document modDoc;
+
+		pugi::xml_parse_result result = modDoc.load_file(filePath.c_str());
+		if (!result) {
+			spdlog::error("Failed to load the XML at path {}", filePath.string());
+
+			continue;
 		}
 		else {
-			spdlog::error("{} isn't a directory!", xmlSourceDir.string());
+			spdlog::info("Loaded the XML at path {}", filePath.string());
 		}
+
+		mod.AddMod(modDoc);
 	}
 
-	bnd->ApplyMod(mod);
+	std::vector<ArchiveResult> results(config.archives.size());
 
-	auto destMatFile = bnd->Pack();
+	// A thread each, so it only takes as long as the biggest archive
+	Parallel::For(config.archives.size(), [&](size_t i) {
+		BuildArchive(config.archives[i], modFiles, mod, results[i]);
+	}, config.archives.size());
 
-	const auto newDCXFilePath = pluginDir / "material" / "allmaterial.matbinbnd.dcx";
+	// Can only tell if every archive was actually looked into
+	bool allUnpacked = std::all_of(results.begin(), results.end(), [](const ArchiveResult& result) { return result.unpacked; });
 
-	destMatFile->WriteFile(newDCXFilePath);
+	if (allUnpacked) {
+		size_t i = 0;
 
-	delete bnd;
-	delete sourceMatFile;
+		for (const auto& change : mod.GetChanges()) {
+			bool found = std::any_of(results.begin(), results.end(), [&](const ArchiveResult& result) { return result.foundTargets[i]; });
+
+			if (!found) {
+				spdlog::warn("None of the archives has a material named {}", change.first);
+			}
 
-	spdlog::info("Finished modding");
+			i++;
+		}
+	}
+
+	const auto endTime = stdtime::high_resolution_clock::now();
+
+	spdlog::info("Finished modding {} archives in {}", config.archives.size(), stdtime::duration_cast<stdtime::milliseconds>(endTime - startTime));
 }
 
 void TestBNDWrite() {
@@ -162,67 +254,149 @@ void TestBNDWrite() {
 
 // Test if the written thing is correct
 
-	size_t bndFileSize = fs::file_size(pluginDir / "test" / "out.bnd");
-	byte* newBNDData = new byte[bndFileSize];
-	std::ifstream newBndFileStream(pluginDir / "test" / "out.bnd");
-	newBndFileStream.read((char *) newBNDData, bndFileSize);
-	auto newBND = BNDFile::Parse(newBNDData, bndFileSize);
+	auto newBND = BNDFile::Open(pluginDir / "test" / "out.bnd");
+
+	if (!newBND) {
+		spdlog::error("BND: Couldn't parse the written file");
+
+		return;
+	}
+
+	// Every matbin of both gets compared anyway
+	bnd->Prewarm();
+	newBND->Prewarm();
 
 	if (bnd->GetSize() != newBND->GetSize()) {
 		spdlog::error("BND: Sizes don't match (this is expected, though) {} != {}", bnd->GetSize(), newBND->GetSize());
 	}
 
 	int failCount = 0;
-	for (const std::string* path : bnd->GetAllMatbinPaths(false)) {
-		auto matbin = newBND->GetMatbin(*path);
+	bnd->ForEachMatbin([&](std::string_view path) {
+		auto matbin = newBND->GetMatbinByPath(path);
 
 		if (!matbin) {
-			spdlog::error("BND: Can't find matbin {}", *path);
+			spdlog::error("BND: Can't find matbin {}", path);
 
 			failCount++;
 
-			continue;
+			return;
 		}
 
-		auto reference = bnd->GetMatbin(*path);
+		auto reference = bnd->GetMatbinByPath(path);
 
 		bool errored = false;
 
 		if (matbin->GetLength() != reference->GetLength()) {
-			spdlog::error("BND: Incorrect matbin {}, lengths don't match: {} != {}", *path, matbin->GetLength(), reference->GetLength());
+			spdlog::error("BND: Incorrect matbin {}, lengths don't match: {} != {}", path, matbin->GetLength(), reference->GetLength());
 
 			errored = true;
 		}
 
 		if (matbin->ParamCount() != reference->ParamCount()) {
-			spdlog::error("BND: Incorrect matbin {}, param counts don't match: {} != {}", *path, matbin->ParamCount(), reference->ParamCount());
+			spdlog::error("BND: Incorrect matbin {}, param counts don't match: {} != {}", path, matbin->ParamCount(), reference->ParamCount());
 
 			errored = true;
 		}
 		if (matbin->SamplerCount() != reference->SamplerCount()) {
-			spdlog::error("BND: Incorrect matbin {}, sampler counts don't match: {} != {}", *path, matbin->SamplerCount(), reference->SamplerCount());
+			spdlog::error("BND: Incorrect matbin {}, sampler counts don't match: {} != {}", path, matbin->SamplerCount(), reference->SamplerCount());
 
 			errored = true;
 		}
 		
 		if (!errored) {
 			if (memcmp(matbin->GetStart(), reference->GetStart(), matbin->GetLength()) != 0) {
-				spdlog::error("BND: Incorrect matbin {}, parameter values don't match", *path);
+				spdlog::error("BND: Incorrect matbin {}, parameter values don't match", path);
 
 				errored = true;
 			}
 		}
 
 		failCount += errored;
-	}
+	}, true);
+
 	if (failCount > 0) {
-		spdlog::error("Final error count: {}/{}", failCount, bnd->GetAllMatbinPaths().size());
+		spdlog::error("Final error count: {}/{}", failCount, bnd->MatbinCount());
 	}
 	else {
 		spdlog::info("All correct");
 	}
 }
 
+void BenchmarkDeflateBackends() {
+	// Times every built in backend on the real material archive, the best of a few runs each
+
+	const auto sourceDCXpath = pluginDir / "assets" / "allmaterial.matbinbnd.dcx";
+	const int runCount = 5;
+
+	spdlog::info("Benchmarking deflate backends");
+
+	auto sourceMatFile = DCXFile::ReadFile(sourceDCXpath);
+
+	if (!sourceMatFile) {
+		spdlog::error("Couldn't read the source material file");
+
+		return;
+	}
+
+	if (sourceMatFile->GetCodec() != DCXCodec::Find("DFLT")) {
+		spdlog::error("The source material file isn't DFLT compressed");
+
+		delete sourceMatFile;
+
+		return;
+	}
+
+	const size_t uncompressedSize = sourceMatFile->GetUncompressedSize();
+	byte* uncompressed = new byte[uncompressedSize];
+	byte* recompressed = new byte[GetMaxCompressedLen(uncompressedSize)];
+
+	for (const DeflateBackend* backend : DeflateBackend::All()) {
+		auto bestInflate = stdtime::nanoseconds::max();
+		auto bestDeflate = stdtime::nanoseconds::max();
+		int compressedSize = -1;
+		bool failed = false;
+
+		for (int i = 0; i < runCount && !failed; i++) {
+			auto startTime = stdtime::high_resolution_clock::now();
+
+			int inflated = backend->Uncompress(sourceMatFile->GetCompressedFileData(), sourceMatFile->GetCompressedSize(), uncompressed, uncompressedSize);
+
+			auto endTime = stdtime::high_resolution_clock::now();
+
+			bestInflate = std::min(bestInflate, stdtime::duration_cast<stdtime::nanoseconds>(endTime - startTime));
+
+			startTime = stdtime::high_resolution_clock::now();
+
+			compressedSize = backend->Compress(uncompressed, uncompressedSize, recompressed, GetMaxCompressedLen(uncompressedSize), Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY);
+
+			endTime = stdtime::high_resolution_clock::now();
+
+			bestDeflate = std::min(bestDeflate, stdtime::duration_cast<stdtime::nanoseconds>(endTime - startTime));
+
+			failed = inflated != (int) uncompressedSize || compressedSize < 0;
+		}
+
+		if (failed) {
+			spdlog::error("{}: failed to roundtrip the archive", backend->GetName());
+
+			continue;
+		}
+
+		spdlog::info(
+			"{}: inflate {}, deflate {} ({} -> {} bytes)",
+			backend->GetName(),
+			stdtime::duration_cast<stdtime::microseconds>(bestInflate),
+			stdtime::duration_cast<stdtime::microseconds>(bestDeflate),
+			uncompressedSize,
+			compressedSize
+		);
+	}
+
+	delete[] recompressed;
+	delete[] uncompressed;
+	delete sourceMatFile;
+}
+
 void Start(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved) {
 	pluginDir = GetLibraryDir(hinstDLL);
 
@@ -230,20 +404,38 @@ void Start(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved) {
 
 	spdlog::info("Initialized Glee");
 
+	config = PluginConfig::Load(pluginDir / "glee.xml");
+
+	if (!config.deflateBackend.empty()) {
+		DeflateBackend::Select(config.deflateBackend);
+	}
+
+	spdlog::info("Using {} for deflate", DeflateBackend::Current()->GetName());
+
 	LoadXMLs();
 }
 
 void Dispose() {
 	spdlog::info("Exiting Glee");
 
-	const auto createdDCXpath = pluginDir / "material" / "allmaterial.matbinbnd.dcx";
+	// The cached builds are reused on the next launch
+	if (config.useBuildCache) {
+		return;
+	}
 
-	if (fs::exists(createdDCXpath)) {
-		if (fs::remove(createdDCXpath)) {
-			spdlog::info("Cleaned up files");
-		}
-		else {
-			spdlog::error("Couldn't clean up files");
+	for (const auto& archive : config.archives) {
+		const auto createdDCXpath = pluginDir / archive.output;
+
+		BuildCache::Invalidate(createdDCXpath);
+		BlockIndex::Remove(createdDCXpath);
+
+		if (fs::exists(createdDCXpath)) {
+			if (fs::remove(createdDCXpath)) {
+				spdlog::info("Cleaned up {}", createdDCXpath.string());
+			}
+			else {
+				spdlog::error("Couldn't clean up {}", createdDCXpath.string());
+			}
 		}
 	}
 }
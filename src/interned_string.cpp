@@ -0,0 +1,92 @@
+#include "interned_string.h"
+
+#include <array>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
+
+#include "utils.h"
+
+// Parsing on several threads mostly hits names that are already in, sharding keeps them off each other's locks
+const size_t interner_shard_count = 16;
+
+struct InternerHash {
+	size_t operator()(std::string_view s) const { return StringUtils::Hash(s); }
+};
+
+struct InternerShard {
+	std::shared_mutex mutex;
+	// The set's nodes never move, so pointers to its elements are the ids
+	std::unordered_set<std::string_view, InternerHash> entries;
+	std::pmr::monotonic_buffer_resource storage;
+	size_t storedSize = 0;
+
+	const std::string_view* Find(std::string_view s) {
+		std::shared_lock lock(this->mutex);
+
+		auto it = this->entries.find(s);
+
+		return it != this->entries.end() ? &*it : nullptr;
+	}
+
+	const std::string_view* Insert(std::string_view s) {
+		std::unique_lock lock(this->mutex);
+
+		// Someone else might have added it since Find
+		auto it = this->entries.find(s);
+
+		if (it != this->entries.end()) {
+			return &*it;
+		}
+
+		char* copy = (char *) this->storage.allocate(s.size() + 1, 1);
+
+		std::copy(s.begin(), s.end(), copy);
+		copy[s.size()] = '\0';
+
+		this->storedSize += s.size() + 1;
+
+		return &*this->entries.insert(std::string_view(copy, s.size())).first;
+	}
+};
+
+static std::array<InternerShard, interner_shard_count>& GetShards() {
+	// Built on first use, so it's there for anything parsed during static initialization too
+	static std::array<InternerShard, interner_shard_count> shards;
+
+	return shards;
+}
+
+static InternerShard& GetShard(std::string_view s) {
+	// The set buckets by the low bits already
+	return GetShards()[(StringUtils::Hash(s) >> 56) % interner_shard_count];
+}
+
+InternedString StringInterner::Intern(std::string_view s) {
+	InternerShard& shard = GetShard(s);
+
+	const std::string_view* entry = shard.Find(s);
+
+	if (!entry) {
+		entry = shard.Insert(s);
+	}
+
+	return InternedString(entry);
+}
+
+InternedString StringInterner::Find(std::string_view s) {
+	return InternedString(GetShard(s).Find(s));
+}
+
+size_t StringInterner::GetStoredSize() {
+	size_t result = 0;
+
+	for (auto& shard : GetShards()) {
+		std::shared_lock lock(shard.mutex);
+
+		result += shard.storedSize;
+	}
+
+	return result;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+class InternedString;
+
+namespace StringInterner {
+	// Safe to call from any thread
+	InternedString Intern(std::string_view s);
+
+	// Doesn't add anything, an empty InternedString if s was never interned
+	// Nothing can have a name that was never interned, so lookups can bail out right away
+	InternedString Find(std::string_view s);
+
+	// Bytes of string data held so far, it's never freed
+	size_t GetStoredSize();
+}
+
+// A string stored once for the whole process, equal strings are the same InternedString
+// Comparing two of them only compares pointers
+class InternedString {
+private:
+	const std::string_view* entry = nullptr;
+
+	explicit InternedString(const std::string_view* entry):
+	entry(entry) {}
+
+	friend InternedString StringInterner::Intern(std::string_view s);
+	friend InternedString StringInterner::Find(std::string_view s);
+
+public:
+	InternedString() = default;
+
+	std::string_view View() const { return this->entry ? *this->entry : std::string_view(); }
+	operator std::string_view() const { return this->View(); }
+
+	size_t size() const { return this->View().size(); }
+	bool empty() const { return this->View().empty(); }
+
+	// False only for the default one
+	explicit operator bool() const { return this->entry != nullptr; }
+
+	bool operator==(const InternedString& other) const { return this->entry == other.entry; }
+
+	// From the address rather than the characters, so it's only good for telling InternedStrings apart
+	uint64_t Hash() const {
+		// The entries are aligned, so the low bits of the address alone would pile everything into a few slots
+		uint64_t hash = (uintptr_t) this->entry * 0x9E3779B97F4A7C15ull;
+
+		return hash ^ (hash >> 32);
+	}
+};
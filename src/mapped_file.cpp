@@ -0,0 +1,175 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "spdlog/spdlog.h"
+
+namespace fs = std::filesystem;
+
+#ifdef _WIN32
+MappedFile::MappedFile():
+	data(nullptr),
+	size(0),
+	fileHandle(INVALID_HANDLE_VALUE),
+	mappingHandle(nullptr) {}
+
+MappedFile::~MappedFile() {
+	if (this->data) {
+		UnmapViewOfFile(this->data);
+	}
+
+	if (this->mappingHandle) {
+		CloseHandle(this->mappingHandle);
+	}
+
+	if (this->fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(this->fileHandle);
+	}
+}
+
+MappedFile* MappedFile::Open(const fs::path& filePath, AccessPattern pattern) {
+	MappedFile* result = new MappedFile();
+
+	DWORD accessFlags = pattern == AccessPattern::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+
+	result->fileHandle = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | accessFlags, nullptr);
+
+	if (result->fileHandle == INVALID_HANDLE_VALUE) {
+		spdlog::error("Cannot open file: {}", filePath.string());
+
+		delete result;
+
+		return nullptr;
+	}
+
+	LARGE_INTEGER fileSize;
+
+	if (!GetFileSizeEx(result->fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+		spdlog::error("Cannot map an empty file: {}", filePath.string());
+
+		delete result;
+
+		return nullptr;
+	}
+
+	result->size = fileSize.QuadPart;
+
+	// Copy on write, so the pages we mod don't end up in the source file
+	result->mappingHandle = CreateFileMappingW(result->fileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+
+	if (result->mappingHandle) {
+		result->data = (byte *) MapViewOfFile(result->mappingHandle, FILE_MAP_COPY, 0, 0, 0);
+	}
+
+	if (!result->data) {
+		spdlog::error("Cannot map file: {}, error {}", filePath.string(), GetLastError());
+
+		delete result;
+
+		return nullptr;
+	}
+
+	// Random access files only get paged in as they're touched
+	if (pattern == AccessPattern::Sequential) {
+		result->Prefetch(0, result->size);
+	}
+
+	return result;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t length) const {
+	if (offset >= this->size) {
+		return;
+	}
+
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = this->data + offset;
+	range.NumberOfBytes = length < this->size - offset ? length : this->size - offset;
+
+	// Only a hint, nothing to do if it fails
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+#else
+MappedFile::MappedFile():
+	data(nullptr),
+	size(0),
+	fileDescriptor(-1) {}
+
+MappedFile::~MappedFile() {
+	if (this->data) {
+		munmap(this->data, this->size);
+	}
+
+	if (this->fileDescriptor >= 0) {
+		close(this->fileDescriptor);
+	}
+}
+
+MappedFile* MappedFile::Open(const fs::path& filePath, AccessPattern pattern) {
+	MappedFile* result = new MappedFile();
+
+	result->fileDescriptor = open(filePath.c_str(), O_RDONLY);
+
+	if (result->fileDescriptor < 0) {
+		spdlog::error("Cannot open file: {}", filePath.string());
+
+		delete result;
+
+		return nullptr;
+	}
+
+	struct stat fileStat;
+
+	if (fstat(result->fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) {
+		spdlog::error("Cannot map an empty file: {}", filePath.string());
+
+		delete result;
+
+		return nullptr;
+	}
+
+	result->size = fileStat.st_size;
+
+	// Copy on write, so the pages we mod don't end up in the source file
+	void* mapping = mmap(nullptr, result->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, result->fileDescriptor, 0);
+
+	if (mapping == MAP_FAILED) {
+		spdlog::error("Cannot map file: {}", filePath.string());
+
+		delete result;
+
+		return nullptr;
+	}
+
+	result->data = (byte *) mapping;
+
+	madvise(result->data, result->size, pattern == AccessPattern::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+
+	// Random access files only get paged in as they're touched
+	if (pattern == AccessPattern::Sequential) {
+		result->Prefetch(0, result->size);
+	}
+
+	return result;
+}
+
+void MappedFile::Prefetch(size_t offset, size_t length) const {
+	if (offset >= this->size) {
+		return;
+	}
+
+	// madvise wants a page aligned start
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t alignedOffset = offset - offset % pageSize;
+	size_t alignedLength = (length < this->size - offset ? length : this->size - offset) + (offset - alignedOffset);
+
+	madvise(this->data + alignedOffset, alignedLength, MADV_WILLNEED);
+}
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <filesystem>
+
+#include "binary.h"
+
+// A private, copy on write mapping of a whole file
+// Writing to the mapped bytes never touches the file on disk, so it can back data that gets modded in place
+class MappedFile {
+public:
+	enum class AccessPattern {
+		Sequential,
+		Random
+	};
+
+private:
+	byte* data;
+	size_t size;
+
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+
+	MappedFile();
+public:
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// nullptr if the file can't be opened or mapped
+	static MappedFile* Open(const std::filesystem::path& filePath, AccessPattern pattern = AccessPattern::Sequential);
+
+	// Asks the kernel to start reading the range in ahead of time
+	void Prefetch(size_t offset, size_t length) const;
+
+	byte* GetData() const { return this->data; }
+	size_t GetSize() const { return this->size; }
+};
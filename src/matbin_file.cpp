@@ -2,8 +2,19 @@
 
 #include <exception>
 
+#include "buffer_writer.h"
+#include "record_schema.h"
+
 // The stuff you'll do to avoid writing code...
-#define SEARCH_PARAMS(arrayName) for (auto& p : arrayName) { if (this->params[p.infoIndex].name == propertyName) { param = &p; break; } };
+#define FIND_PARAM(arrayName, paramType) if (const NameEntry* entry = FindName(propertyName); entry && entry->typedParam >= 0 && this->params[entry->param].type == paramType) { param = &arrayName[entry->typedParam]; }
+
+// Names are short, the scratch buffer keeps them off the heap on their way to the interner
+const size_t name_scratch_size = 0x100;
+// Spare room when relocating, so longer texture paths don't have to grow the buffer
+const size_t relocation_headroom = 0x200;
+// Slots per name in the name index at the least, so probes stay short
+const size_t name_index_slots_per_name = 2;
+const size_t name_index_min_capacity = 8;
 
 enum ParamType {
 	Bool = 0,
@@ -16,27 +27,69 @@ enum ParamType {
 	Float5 = 12,
 };
 
+// The value data that follows a param's name
+static size_t GetValueSize(int type) {
+	switch (type) {
+	case ParamType::Bool:
+		return 1;
+	case ParamType::Int:
+	case ParamType::Float:
+		return 4;
+	case ParamType::Int2:
+	case ParamType::Float2:
+		return 8;
+	// This type is actually a float5, with the last 2 values being useless
+	case ParamType::Float3:
+	case ParamType::Float5:
+		return 20;
+	case ParamType::Float4:
+		return 16;
+	default:
+		throw std::runtime_error(std::format("Unknown MAB param type: {}", type));
+	}
+}
+
+static InternedString ReadName(BufferView& data, uint64_t offset) {
+	char scratch[name_scratch_size];
+	std::pmr::monotonic_buffer_resource scratchMemory(scratch, sizeof(scratch));
+
+	return StringInterner::Intern(data.ReadOffsetUTF16(offset, &scratchMemory));
+}
+
 void MatbinFile::ReadParam(BufferView& data) {
-	std::string paramName = data.ReadOffsetUTF16();
+	using namespace Record;
 
-	uint64_t valueOffset = data.ReadInt64();
-	int key = data.ReadInt32();
-	int type = data.ReadInt32();
+	struct Header {
+		uint64_t nameOffset;
+		uint64_t valueOffset;
+		int key;
+		int type;
+	};
 
-	for (int i = 0; i < 0x10; i++) {
-		data.AssertByte(0, "MAB Padding");
-	}
+	using Schema = RecordSchema<Header,
+		Field<&Header::nameOffset>,
+		Field<&Header::valueOffset>,
+		Field<&Header::key>,
+		Field<&Header::type>,
+		Padding<0x10>
+	>;
 
-	ParamInfo info{paramName, this->start + valueOffset, key, type};
+	static_assert(Schema::size == ParamInfo::GetByteSize());
+
+	const Header header = data.ReadRecord<Schema>("MAB param");
 
 	int infoIndex = this->params.size();
-	this->params.push_back(info);
+	InternedString name = ReadName(data, header.nameOffset);
+	this->params.push_back(ParamInfo{name, this->start + header.valueOffset, header.key, header.type});
 
-	switch (type) {
+	int typedIndex = -1;
+
+	switch (header.type) {
 	case ParamType::Bool:
 	{
 		auto param = MatbinFile::Param<bool, 1>(infoIndex);
 
+		typedIndex = this->boolParams.size();
 		this->boolParams.push_back(param);
 
 		break;
@@ -45,6 +98,7 @@ void MatbinFile::ReadParam(BufferView& data) {
 	{
 		auto param = MatbinFile::Param<int, 1>(infoIndex);
 
+		typedIndex = this->int1Params.size();
 		this->int1Params.push_back(param);
 
 		break;
@@ -53,6 +107,7 @@ void MatbinFile::ReadParam(BufferView& data) {
 	{
 		auto param = MatbinFile::Param<int, 2>(infoIndex);
 
+		typedIndex = this->int2Params.size();
 		this->int2Params.push_back(param);
 
 		break;
@@ -61,6 +116,7 @@ void MatbinFile::ReadParam(BufferView& data) {
 	{
 		auto param = MatbinFile::Param<float, 1>(infoIndex);
 
+		typedIndex = this->float1Params.size();
 		this->float1Params.push_back(param);
 
 		break;
@@ -69,6 +125,7 @@ void MatbinFile::ReadParam(BufferView& data) {
 	{
 		auto param = MatbinFile::Param<float, 2>(infoIndex);
 
+		typedIndex = this->float2Params.size();
 		this->float2Params.push_back(param);
 
 		break;
@@ -77,6 +134,7 @@ void MatbinFile::ReadParam(BufferView& data) {
 	{
 		auto param = MatbinFile::Param<float, 3>(infoIndex);
 
+		typedIndex = this->float3Params.size();
 		this->float3Params.push_back(param);
 
 		break;
@@ -85,6 +143,7 @@ void MatbinFile::ReadParam(BufferView& data) {
 	{
 		auto param = MatbinFile::Param<float, 4>(infoIndex);
 
+		typedIndex = this->float4Params.size();
 		this->float4Params.push_back(param);
 
 		break;
@@ -93,56 +152,165 @@ void MatbinFile::ReadParam(BufferView& data) {
 	{
 		auto param = MatbinFile::Param<float, 5>(infoIndex);
 
+		typedIndex = this->float5Params.size();
 		this->float5Params.push_back(param);
 
 		break;
 	}
+	default:
+		// Relocating has to know how big the value is
+		throw std::runtime_error(std::format("Unknown MAB param type: {}", header.type));
+	}
+
+	// Only the first of the same name is found, like a search front to back would
+	NameEntry& entry = IndexName(name);
+
+	if (entry.param < 0) {
+		entry.param = infoIndex;
+		entry.typedParam = typedIndex;
 	}
 }
 
 void MatbinFile::ReadSampler(BufferView& data) {
+	using namespace Record;
+
+	struct Header {
+		uint64_t nameOffset;
+		uint64_t pathOffset;
+		unsigned int key;
+		float unk1;
+		float unk2;
+	};
+
+	using Schema = RecordSchema<Header,
+		Field<&Header::nameOffset>,
+		Field<&Header::pathOffset>,
+		Field<&Header::key>,
+		Field<&Header::unk1>,
+		Field<&Header::unk2>,
+		Padding<0x14>
+	>;
+
+	static_assert(Schema::size == TextureParam::GetByteSize());
+
 	byte* headerPos = data.GetPos();
 
-	std::string samplerName = data.ReadOffsetUTF16();
-	std::string path = data.ReadOffsetUTF16();
-	unsigned int key = data.ReadInt32();
-	auto unk = data.ReadFloatArray<2>();
+	const Header header = data.ReadRecord<Schema>("MAB sampler");
 
-	for (int i = 0; i < 0x14; i++) {
-		data.AssertByte(0, "MAB Padding");
+	InternedString name = ReadName(data, header.nameOffset);
+
+	NameEntry& entry = IndexName(name);
+
+	if (entry.sampler < 0) {
+		entry.sampler = this->samplers.size();
 	}
 
 	this->samplers.push_back(TextureParam(
 		headerPos,
-		samplerName,
-		path,
-		key,
-		unk[0], unk[1]
+		name,
+		ReadName(data, header.pathOffset),
+		header.key,
+		header.unk1, header.unk2
 	));
 }
 
-MatbinFile::MatbinFile(byte* start, size_t length):
+MatbinFile::NameEntry& MatbinFile::IndexName(InternedString name) {
+	const size_t mask = this->nameIndex.size() - 1;
+	size_t position = name.Hash() & mask;
+
+	// Sized for every name in the constructor, so there's always a free slot
+	while (this->nameIndex[position].name && !(this->nameIndex[position].name == name)) {
+		position = (position + 1) & mask;
+	}
+
+	this->nameIndex[position].name = name;
+
+	return this->nameIndex[position];
+}
+
+const MatbinFile::NameEntry* MatbinFile::FindName(InternedString name) const {
+	if (!name) {
+		return nullptr;
+	}
+
+	const size_t mask = this->nameIndex.size() - 1;
+	size_t position = name.Hash() & mask;
+
+	while (this->nameIndex[position].name) {
+		if (this->nameIndex[position].name == name) {
+			return &this->nameIndex[position];
+		}
+
+		position = (position + 1) & mask;
+	}
+
+	return nullptr;
+}
+
+MatbinFile::MatbinFile(byte* start, size_t length, bool takeOwnership, std::pmr::memory_resource* memory):
 start(start),
 end(start + length),
-relocated(false) {
-	BufferView dataView(start, end, false);
+memory(memory),
+relocated(false),
+ownedData(takeOwnership ? start : nullptr),
+ownedLength(takeOwnership ? length : 0),
+params(memory),
+boolParams(memory),
+int1Params(memory),
+int2Params(memory),
+float1Params(memory),
+float2Params(memory),
+float3Params(memory),
+float4Params(memory),
+float5Params(memory),
+samplers(memory),
+nameIndex(memory) {
+	using namespace Record;
+
+	BufferView dataView(start, end);
 
 	dataView.AssertASCII("MAB", 4, "MAB Magic Value");
-	dataView.AssertInt32(2, "MAB Version");
 
-	this->shaderPath = dataView.ReadOffsetUTF16();
-	
-	this->sourcePath = dataView.ReadOffsetUTF16();
+	struct Header {
+		uint64_t shaderOffset;
+		uint64_t sourceOffset;
+		unsigned int key;
+		int paramCount;
+		int samplerCount;
+	};
+
+	const Header header = dataView.ReadRecord<RecordSchema<Header,
+		Expect<int, 2>, // Version
+		Field<&Header::shaderOffset>,
+		Field<&Header::sourceOffset>,
+		Field<&Header::key>,
+		Field<&Header::paramCount>,
+		Field<&Header::samplerCount>,
+		Padding<0x14>
+	>>("MAB header");
+
+	this->shaderPath = ReadName(dataView, header.shaderOffset);
+	this->sourcePath = ReadName(dataView, header.sourceOffset);
+	this->key = header.key;
+
+	const int paramCount = header.paramCount;
+	const int samplerCount = header.samplerCount;
+
+	if (paramCount < 0 || samplerCount < 0) {
+		throw std::runtime_error(std::format("Invalid MAB counts: {} params, {} samplers", paramCount, samplerCount));
+	}
+
+	this->params.reserve(paramCount);
+	this->samplers.reserve(samplerCount);
 
-	this->key = dataView.ReadInt32();
+	size_t indexCapacity = name_index_min_capacity;
 
-	int paramCount = dataView.ReadInt32();
-	int samplerCount = dataView.ReadInt32();
-	
-	for (int i = 0; i < 0x14; i++) {
-		dataView.AssertByte(0, "MAB Padding");
+	while (indexCapacity < ((size_t) paramCount + samplerCount) * name_index_slots_per_name) {
+		indexCapacity *= 2;
 	}
 
+	this->nameIndex.resize(indexCapacity);
+
 	for (int i = 0; i < paramCount; i++) {
 		ReadParam(dataView);
 	}
@@ -152,58 +320,59 @@ relocated(false) {
 	}
 }
 
+// Only the enabled values change, the rest keep what the file had
 template<typename T, size_t Length>
 requires ParamValue<T, Length>
-bool ApplyPropertyChange(MatbinFile* mat, const PropertyChange& propChange) {
-	if (mat->HasProperty<T, Length>(propChange.target)) {
-		spdlog::info(" Changed property {}", propChange.target);
+static void ApplyPropertyChange(void* valuePtr, const PropertyChange& propChange) {
+	std::array<T, Length> values;
 
-		std::array<T, Length> values = mat->GetPropertyValues<T, Length>(propChange.target);
+	memcpy(values.data(), valuePtr, sizeof(T) * Length);
 
-		for (int i = 0; i < Length; i++) {
-			if (propChange.values[i].enabled) {
-				values[i] = (T) propChange.values[i].value;
-			}
+	for (int i = 0; i < Length; i++) {
+		if (propChange.values[i].enabled) {
+			values[i] = (T) propChange.values[i].value;
 		}
-
-		mat->SetPropertyValues(propChange.target, values);
-
-		return true;
 	}
 
-	return false;
+	memcpy(valuePtr, values.data(), sizeof(T) * Length);
 }
 
 void MatbinFile::ApplyMod(const MaterialChange& change) {
 	for (const auto& propChange : change.GetPropertyChanges()) {
-		bool result = (
-			ApplyPropertyChange<bool, 1>(this, propChange)
-			||
-			ApplyPropertyChange<int, 1>(this, propChange)
-			||
-			ApplyPropertyChange<int, 2>(this, propChange)
-			||
-			ApplyPropertyChange<float, 1>(this, propChange)
-			||
-			ApplyPropertyChange<float, 2>(this, propChange)
-			||
-			ApplyPropertyChange<float, 3>(this, propChange)
-			||
-			ApplyPropertyChange<float, 4>(this, propChange)
-			||
-			ApplyPropertyChange<float, 5>(this, propChange)
-		);
-
-		if (!result) {
+		// One lookup gives the param and its type
+		const NameEntry* entry = FindName(StringInterner::Find(propChange.target));
+
+		if (!entry || entry->param < 0) {
 			spdlog::error("Couldn't find param named {}, continuing to the next one", propChange.target);
+
+			continue;
+		}
+
+		const ParamInfo& paramInfo = this->params[entry->param];
+
+		switch (paramInfo.type) {
+		case ParamType::Bool: ApplyPropertyChange<bool, 1>(paramInfo.valuePtr, propChange); break;
+		case ParamType::Int: ApplyPropertyChange<int, 1>(paramInfo.valuePtr, propChange); break;
+		case ParamType::Int2: ApplyPropertyChange<int, 2>(paramInfo.valuePtr, propChange); break;
+		case ParamType::Float: ApplyPropertyChange<float, 1>(paramInfo.valuePtr, propChange); break;
+		case ParamType::Float2: ApplyPropertyChange<float, 2>(paramInfo.valuePtr, propChange); break;
+		case ParamType::Float3: ApplyPropertyChange<float, 3>(paramInfo.valuePtr, propChange); break;
+		case ParamType::Float4: ApplyPropertyChange<float, 4>(paramInfo.valuePtr, propChange); break;
+		case ParamType::Float5: ApplyPropertyChange<float, 5>(paramInfo.valuePtr, propChange); break;
+		default:
+			spdlog::error("Param {} has the unknown type {}, continuing to the next one", propChange.target, paramInfo.type);
+
+			continue;
 		}
+
+		spdlog::info(" Changed property {}", propChange.target);
 	}
 
-	int sizeChange = 0;
+	bool pathsChanged = false;
 
 	for (const auto& texChange : change.GetTextureChanges()) {
-		TextureParam* param;
-		GetSampler(param, texChange.target);
+		TextureParam* param = nullptr;
+		GetSampler(param, StringInterner::Find(texChange.target));
 
 		if (!param) {
 			spdlog::error("Couldn't find sampler named {}, continuing to the next one", texChange.target);
@@ -213,137 +382,141 @@ void MatbinFile::ApplyMod(const MaterialChange& change) {
 
 		spdlog::info(" Changed texture path {}", texChange.target);
 
-		sizeChange += (texChange.newPath.length() - param->path.length()) * 2;
+		InternedString newPath = StringInterner::Intern(texChange.newPath);
 
-		param->path = texChange.newPath;
-	}
+		// The paths live at the end of the data, so even one of the same length means writing it again
+		pathsChanged |= newPath != param->path;
 
-	spdlog::info("Size change: {}", sizeChange);
+		param->path = newPath;
+	}
 
-	if (sizeChange != 0) {
-		size_t newLength = this->end - this->start + sizeChange;
+	if (pathsChanged) {
+		const size_t oldLength = this->GetLength();
 
-		byte* newLocation = new byte[newLength];
+		Relocate();
 
-		Relocate(newLocation, newLength);
+		spdlog::info("Size change: {}", (ptrdiff_t) this->GetLength() - (ptrdiff_t) oldLength);
 	}
 }
 
-void MatbinFile::Relocate(byte* newStart, size_t newLength) {
-	BufferView dataView(newStart, newLength, false);
+MatbinFile::~MatbinFile() {
+	FreeOwnedData();
+}
 
-	dataView.WriteASCII("MAB", true);
-	dataView.WriteInt32(2);
+void MatbinFile::FreeOwnedData() {
+	if (this->ownedData) {
+		this->memory->deallocate(this->ownedData, this->ownedLength, 1);
+	}
 
-	int shaderOffset = newLength - (this->shaderPath.size() + this->sourcePath.size() + 2) * 2;
-	dataView.WriteInt64(shaderOffset);
-	dataView.SetOffset(shaderOffset);
-	dataView.WriteUTF16(this->shaderPath);
-	dataView.SetOffset(16);
+	this->ownedData = nullptr;
+	this->ownedLength = 0;
+}
 
-	int sourceOffset = newLength - (this->sourcePath.size() + 1) * 2;
-	dataView.WriteInt64(sourceOffset);
-	dataView.SetOffset(sourceOffset);
-	dataView.WriteUTF16(this->sourcePath);
-	dataView.SetOffset(24);
+void MatbinFile::Rebase(byte* newStart) {
+	const ptrdiff_t shift = newStart - this->start;
 
-	dataView.WriteInt32(this->key);
-	dataView.WriteInt32(this->params.size());
-	dataView.WriteInt32(this->SamplerCount());
+	for (auto& paramInfo : this->params) {
+		paramInfo.valuePtr = (byte *) paramInfo.valuePtr + shift;
+	}
 
-	dataView.Write(std::array<byte, 0x14>({0}));
+	for (auto& sampler : this->samplers) {
+		sampler.header += shift;
+	}
 
-	int baseOffset = dataView.GetOffset() + this->params.size() * ParamInfo::GetByteSize() + this->samplers.size() * TextureParam::GetByteSize();
-	int nameOffset = 0;
+	this->end = newStart + (this->end - this->start);
+	this->start = newStart;
 
-	for (const auto& paramInfo : this->params) {
-		dataView.WriteInt64(baseOffset + nameOffset);
-		dataView.WriteInt64((uint64_t) ((byte *) paramInfo.valuePtr - this->start));
-		dataView.WriteInt32(paramInfo.key);
-		dataView.WriteInt32(paramInfo.type);
+	FreeOwnedData();
+}
 
-		dataView.Write<0x10>({0});
-		
-		nameOffset += (paramInfo.name.size() * 2 + 2);
+void MatbinFile::Relocate() {
+	using NameSlot = BufferWriter::Slot<uint64_t>;
 
-		int additionalOffset = 0;
-		switch (paramInfo.type) {
-			case ParamType::Bool:
-				additionalOffset += 1;
-				break;
-			case ParamType::Float5:
-				additionalOffset += 4;
-			case ParamType::Float4:
-				additionalOffset += 4;
-			case ParamType::Float3:
-				additionalOffset += 4;
-			case ParamType::Int2:
-			case ParamType::Float2:
-				additionalOffset += 4;
-			case ParamType::Int:
-			case ParamType::Float:
-				additionalOffset += 4;
-				break;
-		}
+	BufferWriter writer(this->GetLength() + relocation_headroom, this->memory);
 
-		// This type is actually a float5, with the last 2 values being useless
-		// We still have to account for their size though
-		if (paramInfo.type == ParamType::Float3) {
-			additionalOffset += 8;
-		}
+	writer.WriteASCII("MAB");
+	writer.WriteInt32(2);
+	NameSlot shaderOffset = writer.ReserveSlot<uint64_t>();
+	NameSlot sourceOffset = writer.ReserveSlot<uint64_t>();
+	writer.WriteInt32(this->key);
+	writer.WriteInt32(this->params.size());
+	writer.WriteInt32(this->samplers.size());
+	writer.WriteZeroes(0x14);
+
+	// Name and value slots of every param, then name and path slots of every sampler
+	std::vector<NameSlot> slots;
+	slots.reserve(this->params.size() * 2 + this->samplers.size() * 2);
 
-		nameOffset += additionalOffset;
+	for (const auto& paramInfo : this->params) {
+		slots.push_back(writer.ReserveSlot<uint64_t>());
+		slots.push_back(writer.ReserveSlot<uint64_t>());
+		writer.WriteInt32(paramInfo.key);
+		writer.WriteInt32(paramInfo.type);
+		writer.WriteZeroes(0x10);
 	}
 
+	std::vector<size_t> samplerOffsets;
+	samplerOffsets.reserve(this->samplers.size());
+
 	for (const auto& sampler : this->samplers) {
-		dataView.WriteInt64(baseOffset + nameOffset);
+		samplerOffsets.push_back(writer.GetOffset());
+
+		slots.push_back(writer.ReserveSlot<uint64_t>());
+		slots.push_back(writer.ReserveSlot<uint64_t>());
+		writer.WriteInt32(sampler.key);
+		writer.WriteFloat(sampler.unk[0]);
+		writer.WriteFloat(sampler.unk[1]);
+		writer.WriteZeroes(0x14);
+	}
 
-		nameOffset += sampler.name.size() * 2 + 2;
+	auto nextSlot = slots.begin();
 
-		dataView.WriteInt64(baseOffset + nameOffset);
+	// The values are copied as they are, they're already in the file's byte order
+	std::vector<size_t> valueOffsets;
+	valueOffsets.reserve(this->params.size());
 
-		nameOffset += sampler.path.size() * 2 + 2;
+	for (const auto& paramInfo : this->params) {
+		writer.FillWithOffset(*nextSlot++);
+		writer.WriteUTF16(paramInfo.name);
+
+		writer.FillWithOffset(*nextSlot++);
+		valueOffsets.push_back(writer.GetOffset());
+		writer.WriteData((const byte *) paramInfo.valuePtr, GetValueSize(paramInfo.type));
+	}
 
-		dataView.WriteInt32(sampler.key);
-		dataView.WriteInt32(sampler.unk[0]);
-		dataView.WriteInt32(sampler.unk[1]);
+	for (const auto& sampler : this->samplers) {
+		writer.FillWithOffset(*nextSlot++);
+		writer.WriteUTF16(sampler.name);
 
-		dataView.Write<0x14>({0});
+		writer.FillWithOffset(*nextSlot++);
+		writer.WriteUTF16(sampler.path);
 	}
 
-	for (auto& paramInfo : this->params) {
-		dataView.WriteUTF16(paramInfo.name);
-		
-		void* newValuePtr = dataView.GetPos();
+	writer.FillWithOffset(shaderOffset);
+	writer.WriteUTF16(this->shaderPath);
 
-		if (paramInfo.type == ParamType::Bool) {
-			dataView.Write<1>({* (bool *)paramInfo.valuePtr});
-		}
-		else if (paramInfo.type & ParamType::Float) {
-			for (int i = 0; i < (paramInfo.type & 7) + 1; i++) {
-				dataView.WriteFloat(* ((float *) paramInfo.valuePtr + i));
-			}
-
-			if (paramInfo.type == ParamType::Float3) {
-				dataView.WriteFloat(1);
-				dataView.WriteFloat(1);
-			}
-		}
-		else if (paramInfo.type & ParamType::Int) {
+	writer.FillWithOffset(sourceOffset);
+	writer.WriteUTF16(this->sourcePath);
 
-			for (int i = 0; i < (paramInfo.type & 1) + 1; i++) {
-				dataView.WriteInt32(* ((int *) paramInfo.valuePtr + i));
-			}
-		}
+	// Nothing reads the old data past this point, the values were copied above
+	const size_t newLength = writer.GetSize();
+	const size_t newCapacity = writer.GetCapacity();
+	byte* newStart = writer.Release();
 
-		paramInfo.valuePtr = newValuePtr;
+	for (size_t i = 0; i < this->params.size(); i++) {
+		this->params[i].valuePtr = newStart + valueOffsets[i];
 	}
 
-	for (const auto& sampler : this->samplers) {
-		dataView.WriteUTF16(sampler.name);
-		dataView.WriteUTF16(sampler.path);
+	for (size_t i = 0; i < this->samplers.size(); i++) {
+		this->samplers[i].header = newStart + samplerOffsets[i];
 	}
 
+	// The old data is either a view into the BND or an earlier copy of ours
+	FreeOwnedData();
+
+	this->ownedData = newStart;
+	this->ownedLength = newCapacity;
+
 	this->start = newStart;
 	this->end = newStart + newLength;
 
@@ -366,19 +539,16 @@ template<typename T, size_t Length>
 constexpr int GetByteLength(const std::array<T, Length>&) {
 	return sizeof(T) * Length;
 }
-void MatbinFile::GetParam(Param<bool, 1>*& param, const std::string& propertyName) { SEARCH_PARAMS(this->boolParams) }
-void MatbinFile::GetParam(Param<int, 1>*& param, const std::string& propertyName) { SEARCH_PARAMS(this->int1Params) }
-void MatbinFile::GetParam(Param<int, 2>*& param, const std::string& propertyName) { SEARCH_PARAMS(this->int2Params) }
-void MatbinFile::GetParam(Param<float, 1>*& param, const std::string& propertyName) { SEARCH_PARAMS(this->float1Params) }
-void MatbinFile::GetParam(Param<float, 2>*& param, const std::string& propertyName) { SEARCH_PARAMS(this->float2Params) }
-void MatbinFile::GetParam(Param<float, 3>*& param, const std::string& propertyName) { SEARCH_PARAMS(this->float3Params) }
-void MatbinFile::GetParam(Param<float, 4>*& param, const std::string& propertyName) { SEARCH_PARAMS(this->float4Params) }
-void MatbinFile::GetParam(Param<float, 5>*& param, const std::string& propertyName) { SEARCH_PARAMS(this->float5Params) }
-void MatbinFile::GetSampler(TextureParam*& param, const std::string& propertyName) {
-	for (auto& sampler : this->samplers) {
-		if (sampler.name == propertyName) {
-			param = &sampler;
-			break;
-		}
-	};
+void MatbinFile::GetParam(Param<bool, 1>*& param, InternedString propertyName) { FIND_PARAM(this->boolParams, ParamType::Bool) }
+void MatbinFile::GetParam(Param<int, 1>*& param, InternedString propertyName) { FIND_PARAM(this->int1Params, ParamType::Int) }
+void MatbinFile::GetParam(Param<int, 2>*& param, InternedString propertyName) { FIND_PARAM(this->int2Params, ParamType::Int2) }
+void MatbinFile::GetParam(Param<float, 1>*& param, InternedString propertyName) { FIND_PARAM(this->float1Params, ParamType::Float) }
+void MatbinFile::GetParam(Param<float, 2>*& param, InternedString propertyName) { FIND_PARAM(this->float2Params, ParamType::Float2) }
+void MatbinFile::GetParam(Param<float, 3>*& param, InternedString propertyName) { FIND_PARAM(this->float3Params, ParamType::Float3) }
+void MatbinFile::GetParam(Param<float, 4>*& param, InternedString propertyName) { FIND_PARAM(this->float4Params, ParamType::Float4) }
+void MatbinFile::GetParam(Param<float, 5>*& param, InternedString propertyName) { FIND_PARAM(this->float5Params, ParamType::Float5) }
+void MatbinFile::GetSampler(TextureParam*& param, InternedString propertyName) {
+	if (const NameEntry* entry = FindName(propertyName); entry && entry->sampler >= 0) {
+		param = &this->samplers[entry->sampler];
+	}
 }
\ No newline at end of file
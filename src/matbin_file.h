@@ -4,8 +4,10 @@
 #include <vector>
 #include <map>
 #include <concepts>
+#include <memory_resource>
 
 #include "binary.h"
+#include "interned_string.h"
 #include "material_change.h"
 #include "utils.h"
 
@@ -24,7 +26,7 @@ concept ParamValue = (
 class MatbinFile {
 private:
 	struct ParamInfo {
-		std::string name;
+		InternedString name;
 		void* valuePtr;
 		int key;
 		int type;
@@ -61,12 +63,12 @@ private:
 
 	struct TextureParam {
 		byte* header;
-		const std::string name;
-		std::string path;
+		const InternedString name;
+		InternedString path;
 		const unsigned int key;
 		const std::array<float, 2> unk;
 
-		TextureParam(byte* header, const std::string& name, std::string path, unsigned int key, const float unk1, const float unk2):
+		TextureParam(byte* header, InternedString name, InternedString path, unsigned int key, const float unk1, const float unk2):
 		header(header),
 		name(name),
 		path(path),
@@ -80,32 +82,58 @@ private:
 		}
 	};
 
+	// Where a name leads, -1 for whatever it isn't the name of
+	struct NameEntry {
+		InternedString name;
+		// Into params
+		short param = -1;
+		// Into the list of the param's type, e.g. float3Params
+		short typedParam = -1;
+		// Into samplers
+		short sampler = -1;
+	};
+
 	byte* start;
 	byte* end;
 	byte* dumbDataEnd;
 
-	std::string shaderPath;
-	std::string sourcePath;
+	// Everything below and the relocated data come from here
+	std::pmr::memory_resource* memory;
+
+	InternedString shaderPath;
+	InternedString sourcePath;
 	unsigned int key;
 	bool relocated;
-
-	std::vector<ParamInfo> params;
-	std::vector<Param<bool>> boolParams;
-	std::vector<Param<int, 1>> int1Params;
-	std::vector<Param<int, 2>> int2Params;
-	std::vector<Param<float, 1>> float1Params;
-	std::vector<Param<float, 2>> float2Params;
-	std::vector<Param<float, 3>> float3Params;
-	std::vector<Param<float, 4>> float4Params;
-	std::vector<Param<float, 5>> float5Params;
-	std::vector<TextureParam> samplers;
+	// Set when the data lives in a buffer of our own rather than in the BND
+	byte* ownedData;
+	size_t ownedLength;
+
+	std::pmr::vector<ParamInfo> params;
+	std::pmr::vector<Param<bool>> boolParams;
+	std::pmr::vector<Param<int, 1>> int1Params;
+	std::pmr::vector<Param<int, 2>> int2Params;
+	std::pmr::vector<Param<float, 1>> float1Params;
+	std::pmr::vector<Param<float, 2>> float2Params;
+	std::pmr::vector<Param<float, 3>> float3Params;
+	std::pmr::vector<Param<float, 4>> float4Params;
+	std::pmr::vector<Param<float, 5>> float5Params;
+	std::pmr::vector<TextureParam> samplers;
+	// Open addressing by the interned name, sized for every param and sampler up front and only read after the constructor
+	std::pmr::vector<NameEntry> nameIndex;
 
 	std::map<std::string, int> propertyOffsets;
 
 	void ReadParam(BufferView& data);
 	void ReadSampler(BufferView& data);
 
-	void Relocate(byte* newStart, size_t newLength);
+	// The entry for name, a fresh one if it isn't in the index yet
+	NameEntry& IndexName(InternedString name);
+	// nullptr if nothing in the file has that name
+	const NameEntry* FindName(InternedString name) const;
+
+	// Writes everything out again into a buffer of our own, e.g. after a texture path changed
+	void Relocate();
+	void FreeOwnedData();
 
 	template<typename T, size_t Length>
 	requires ParamValue<T, Length>
@@ -113,21 +141,30 @@ private:
 		return (T *) this->params[param->infoIndex].valuePtr;
 	}
 
-	void GetParam(Param<bool, 1>*& param, const std::string& propertyName);
-	void GetParam(Param<int, 1>*& param, const std::string& propertyName);
-	void GetParam(Param<int, 2>*& param, const std::string& propertyName);
-	void GetParam(Param<float, 1>*& param, const std::string& propertyName);
-	void GetParam(Param<float, 2>*& param, const std::string& propertyName);
-	void GetParam(Param<float, 3>*& param, const std::string& propertyName);
-	void GetParam(Param<float, 4>*& param, const std::string& propertyName);
-	void GetParam(Param<float, 5>*& param, const std::string& propertyName);
-	void GetSampler(TextureParam*& param, const std::string& propertyName);
+	void GetParam(Param<bool, 1>*& param, InternedString propertyName);
+	void GetParam(Param<int, 1>*& param, InternedString propertyName);
+	void GetParam(Param<int, 2>*& param, InternedString propertyName);
+	void GetParam(Param<float, 1>*& param, InternedString propertyName);
+	void GetParam(Param<float, 2>*& param, InternedString propertyName);
+	void GetParam(Param<float, 3>*& param, InternedString propertyName);
+	void GetParam(Param<float, 4>*& param, InternedString propertyName);
+	void GetParam(Param<float, 5>*& param, InternedString propertyName);
+	void GetSampler(TextureParam*& param, InternedString propertyName);
 public:
-	MatbinFile(byte* start, size_t length);
+	// Only a view of the data, unless it's handed over with takeOwnership, in which case it has to come from memory
+	MatbinFile(byte* start, size_t length, bool takeOwnership = false, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+	~MatbinFile();
+
+	MatbinFile(const MatbinFile&) = delete;
+	MatbinFile& operator=(const MatbinFile&) = delete;
+
+	// Points the file at an identical copy of its data, e.g. after the BND got relocated
+	// Frees the buffer the file owned so far
+	void Rebase(byte* newStart);
 
 	template<typename T, size_t Length>
 	requires ParamValue<T, Length>
-	bool HasProperty(const std::string& propertyName) {
+	bool HasProperty(InternedString propertyName) {
 		Param<T, Length>* param = nullptr;
 
 		GetParam(param, propertyName);
@@ -137,13 +174,19 @@ public:
 
 	template<typename T, size_t Length>
 	requires ParamValue<T, Length>
-	std::array<T, Length> GetPropertyValues(const std::string& propertyName) {
+	bool HasProperty(std::string_view propertyName) {
+		return HasProperty<T, Length>(StringInterner::Find(propertyName));
+	}
+
+	template<typename T, size_t Length>
+	requires ParamValue<T, Length>
+	std::array<T, Length> GetPropertyValues(InternedString propertyName) {
 		Param<T, Length>* param = nullptr;
 
 		GetParam(param, propertyName);
 
 		if (!param) {
-			throw std::out_of_range(std::format("No param named {}", propertyName));
+			throw std::out_of_range(std::format("No param named {}", propertyName.View()));
 		}
 
 		std::array<T, Length> result{0};
@@ -155,13 +198,19 @@ public:
 
 	template<typename T, size_t Length>
 	requires ParamValue<T, Length>
-	void SetPropertyValues(const std::string& propertyName, const std::array<T, Length>& values) {
+	std::array<T, Length> GetPropertyValues(std::string_view propertyName) {
+		return GetPropertyValues<T, Length>(StringInterner::Find(propertyName));
+	}
+
+	template<typename T, size_t Length>
+	requires ParamValue<T, Length>
+	void SetPropertyValues(InternedString propertyName, const std::array<T, Length>& values) {
 		Param<T, Length>* param = nullptr;
 
 		GetParam(param, propertyName);
 
 		if (!param) {
-			throw std::out_of_range(std::format("No param named {}", propertyName));
+			throw std::out_of_range(std::format("No param named {}", propertyName.View()));
 		}
 
 		memcpy(const_cast<T *>(GetParamValue(param)), values.data(), sizeof(T) * Length);
@@ -169,6 +218,12 @@ public:
 		spdlog::info("  Value: {} {} {}", GetParamValue(param)[0], GetParamValue(param)[1], GetParamValue(param)[2]);
 	}
 
+	template<typename T, size_t Length>
+	requires ParamValue<T, Length>
+	void SetPropertyValues(std::string_view propertyName, const std::array<T, Length>& values) {
+		SetPropertyValues<T, Length>(StringInterner::Find(propertyName), values);
+	}
+
 	void ApplyMod(const MaterialChange& change);
 
 	inline byte* GetStart() { return this->start; }
@@ -0,0 +1,84 @@
+#include "name_index.h"
+
+#include "utils.h"
+
+// Keeps the probe sequences short, the index is tiny compared to the BND anyway
+const size_t name_index_max_load_percent = 50;
+const size_t name_index_min_capacity = 16;
+
+void NameIndex::Reserve(size_t count) {
+	size_t capacity = name_index_min_capacity;
+
+	while (capacity * name_index_max_load_percent / 100 < count) {
+		capacity *= 2;
+	}
+
+	this->entries.reserve(count);
+
+	if (capacity <= this->slots.size()) {
+		return;
+	}
+
+	this->slots.assign(capacity, Slot{ 0, empty_slot });
+	this->mask = capacity - 1;
+
+	for (uint32_t i = 0; i < this->entries.size(); i++) {
+		uint64_t hash = StringUtils::Hash(this->entries[i].name);
+		size_t position = hash & this->mask;
+
+		while (this->slots[position].entry != empty_slot) {
+			position = (position + 1) & this->mask;
+		}
+
+		this->slots[position] = Slot{ hash, i };
+	}
+}
+
+void NameIndex::Grow() {
+	this->Reserve(std::max<size_t>(name_index_min_capacity, this->slots.size()));
+}
+
+bool NameIndex::Insert(std::string_view name, uint32_t value) {
+	if ((this->entries.size() + 1) * 100 > this->slots.size() * name_index_max_load_percent) {
+		this->Grow();
+	}
+
+	uint64_t hash = StringUtils::Hash(name);
+	size_t position = hash & this->mask;
+
+	while (this->slots[position].entry != empty_slot) {
+		const Slot& slot = this->slots[position];
+
+		if (slot.hash == hash && this->entries[slot.entry].name == name) {
+			return false;
+		}
+
+		position = (position + 1) & this->mask;
+	}
+
+	this->slots[position] = Slot{ hash, (uint32_t) this->entries.size() };
+	this->entries.push_back(Entry{ name, value });
+
+	return true;
+}
+
+const NameIndex::Entry* NameIndex::Find(std::string_view name) const {
+	if (this->slots.empty()) {
+		return nullptr;
+	}
+
+	uint64_t hash = StringUtils::Hash(name);
+	size_t position = hash & this->mask;
+
+	while (this->slots[position].entry != empty_slot) {
+		const Slot& slot = this->slots[position];
+
+		if (slot.hash == hash && this->entries[slot.entry].name == name) {
+			return &this->entries[slot.entry];
+		}
+
+		position = (position + 1) & this->mask;
+	}
+
+	return nullptr;
+}
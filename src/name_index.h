@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Flat open addressing map from names to entry indices, built once and then only read
+// The names aren't copied, whatever they point into has to outlive the index
+class NameIndex {
+public:
+	struct Entry {
+		std::string_view name;
+		uint32_t value;
+	};
+
+private:
+	struct Slot {
+		uint64_t hash;
+		// Index into entries, empty_slot if the slot is free
+		uint32_t entry;
+	};
+
+	static constexpr uint32_t empty_slot = UINT32_MAX;
+
+	std::vector<Slot> slots;
+	// In insertion order, that's also the iteration order
+	std::vector<Entry> entries;
+	size_t mask = 0;
+
+	void Grow();
+public:
+	void Reserve(size_t count);
+
+	// False if the name is already in there, the old value stays
+	bool Insert(std::string_view name, uint32_t value);
+
+	// nullptr if there's no such name
+	const Entry* Find(std::string_view name) const;
+
+	size_t Size() const { return this->entries.size(); }
+
+	std::vector<Entry>::const_iterator begin() const { return this->entries.begin(); }
+	std::vector<Entry>::const_iterator end() const { return this->entries.end(); }
+};
@@ -0,0 +1,144 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct WorkRange {
+	std::mutex mutex;
+	size_t begin = 0;
+	size_t end = 0;
+};
+
+// Takes the upper half of the biggest range that's left, false once there's nothing left anywhere
+static bool StealWork(std::vector<std::unique_ptr<WorkRange>>& ranges, WorkRange& own) {
+	while (true) {
+		WorkRange* victim = nullptr;
+		size_t victimSize = 0;
+
+		// Only a hint, it gets checked again under the lock
+		for (auto& range : ranges) {
+			std::lock_guard lock(range->mutex);
+
+			if (range->end - range->begin > victimSize) {
+				victim = range.get();
+				victimSize = range->end - range->begin;
+			}
+		}
+
+		if (!victim) {
+			return false;
+		}
+
+		size_t stolenBegin, stolenEnd;
+
+		{
+			std::lock_guard lock(victim->mutex);
+
+			if (victim->begin >= victim->end) {
+				continue;
+			}
+
+			stolenEnd = victim->end;
+			stolenBegin = victim->begin + (victim->end - victim->begin) / 2;
+
+			victim->end = stolenBegin;
+		}
+
+		// A range of one item can't be split, take it whole
+		if (stolenBegin == stolenEnd) {
+			continue;
+		}
+
+		std::lock_guard lock(own.mutex);
+
+		own.begin = stolenBegin;
+		own.end = stolenEnd;
+
+		return true;
+	}
+}
+
+void Parallel::For(size_t count, const std::function<void(size_t index)>& task, int nThreads) {
+	if (count == 0) {
+		return;
+	}
+
+	if (nThreads <= 0) {
+		nThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	nThreads = std::min<size_t>(nThreads, count);
+
+	std::vector<std::unique_ptr<WorkRange>> ranges;
+	ranges.reserve(nThreads);
+
+	for (int i = 0; i < nThreads; i++) {
+		auto range = std::make_unique<WorkRange>();
+
+		range->begin = count * i / nThreads;
+		range->end = count * (i + 1) / nThreads;
+
+		ranges.push_back(std::move(range));
+	}
+
+	std::atomic<bool> failed = false;
+	std::exception_ptr firstError;
+	std::mutex errorMutex;
+
+	auto worker = [&](int workerIndex) {
+		WorkRange& own = *ranges[workerIndex];
+
+		while (!failed) {
+			size_t index;
+
+			{
+				std::lock_guard lock(own.mutex);
+
+				index = own.begin < own.end ? own.begin++ : count;
+			}
+
+			if (index == count) {
+				if (!StealWork(ranges, own)) {
+					return;
+				}
+
+				continue;
+			}
+
+			try {
+				task(index);
+			} catch (...) {
+				std::lock_guard lock(errorMutex);
+
+				if (!firstError) {
+					firstError = std::current_exception();
+				}
+
+				failed = true;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(nThreads - 1);
+
+	for (int i = 1; i < nThreads; i++) {
+		workers.emplace_back(worker, i);
+	}
+
+	// The calling thread pulls its weight too
+	worker(0);
+
+	for (auto& thread : workers) {
+		thread.join();
+	}
+
+	if (firstError) {
+		std::rethrow_exception(firstError);
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace Parallel {
+	// Runs task(i) for every i in [0, count) on nThreads workers (all cores by default) and returns once they're all done
+	// Every worker starts on its own contiguous slice and steals half of the biggest slice left once it runs out
+	// The first exception thrown by a task gets rethrown here, the remaining indices are skipped
+	void For(size_t count, const std::function<void(size_t index)>& task, int nThreads = 0);
+}
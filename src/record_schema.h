@@ -0,0 +1,116 @@
+#pragma once
+
+#include <concepts>
+#include <cstring>
+#include <type_traits>
+
+#include "binary.h"
+
+// Fixed size records described field by field, so BufferView::ReadRecord can check the bounds once
+// and decode every field from a constant offset, instead of a checked read per field
+// e.g. RecordSchema<Header, Field<&Header::count>, Padding<4>, Expect<int, -1>>
+namespace Record {
+	template<typename T>
+	concept Scalar = std::integral<T> || std::floating_point<T>;
+
+	template<Endian Order, Scalar T>
+	inline T Load(const byte* p) {
+		T value;
+
+		if constexpr (std::floating_point<T>) {
+			static_assert(sizeof(T) == sizeof(uint32_t));
+
+			uint32_t bits;
+			memcpy(&bits, p, sizeof(bits));
+
+			if constexpr (Order == Endian::Big) {
+				bits = BigEndianBufferView::ReverseEndianess(bits);
+			}
+
+			memcpy(&value, &bits, sizeof(value));
+		}
+		else {
+			memcpy(&value, p, sizeof(value));
+
+			if constexpr (Order == Endian::Big) {
+				value = BigEndianBufferView::ReverseEndianess(value);
+			}
+		}
+
+		return value;
+	}
+
+	template<auto Member>
+	struct Field;
+
+	// A member of the decoded struct, as many bytes as its type, bools are a byte that's 1 when true
+	template<typename Struct, Scalar T, T Struct::* Member>
+	struct Field<Member> {
+		static constexpr size_t size = std::is_same_v<T, bool> ? 1 : sizeof(T);
+
+		template<Endian Order>
+		static bool Decode(const byte* p, Struct& result) {
+			if constexpr (std::is_same_v<T, bool>) {
+				result.*Member = *p == 1;
+			}
+			else {
+				result.*Member = Load<Order, T>(p);
+			}
+
+			return true;
+		}
+	};
+
+	// Has to be all zeroes
+	template<size_t Size>
+	struct Padding {
+		static constexpr size_t size = Size;
+
+		template<Endian Order, typename Struct>
+		static bool Decode(const byte* p, Struct&) {
+			// Constant sized, so the compiler turns this into a couple of wide compares
+			static constexpr byte zeroes[Size] = {0};
+
+			return memcmp(p, zeroes, Size) == 0;
+		}
+	};
+
+	// A value that's always the same, e.g. the header size
+	template<Scalar T, T Value>
+	struct Expect {
+		static constexpr size_t size = sizeof(T);
+
+		template<Endian Order, typename Struct>
+		static bool Decode(const byte* p, Struct&) {
+			return Load<Order, T>(p) == Value;
+		}
+	};
+
+	// Read past without looking at it
+	template<size_t Size>
+	struct Skip {
+		static constexpr size_t size = Size;
+
+		template<Endian Order, typename Struct>
+		static bool Decode(const byte*, Struct&) {
+			return true;
+		}
+	};
+}
+
+template<typename DecodedStruct, typename... Parts>
+struct RecordSchema {
+	using Struct = DecodedStruct;
+
+	static constexpr size_t size = (Parts::size + ... + 0);
+
+	// Offset of the first part that didn't check out, or size if they all did
+	template<Endian Order>
+	static size_t Decode(const byte* p, Struct& result) {
+		size_t offset = 0;
+
+		((Parts::template Decode<Order>(p + offset, result) && (offset += Parts::size, true)) && ...);
+
+		return offset;
+	}
+};
@@ -0,0 +1,316 @@
+#include "utf16.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define GLEE_UTF16_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+	#include <emmintrin.h>
+	#define GLEE_UTF16_SSE2
+#endif
+
+static inline uint16_t LoadUnit(const byte* p) {
+	return p[0] | (p[1] << 8);
+}
+
+static inline void StoreUnit(byte* p, uint16_t unit) {
+	p[0] = unit & 0xFF;
+	p[1] = unit >> 8;
+}
+
+static inline bool IsHighSurrogate(uint32_t unit) { return unit >= 0xD800 && unit <= 0xDBFF; }
+static inline bool IsLowSurrogate(uint32_t unit) { return unit >= 0xDC00 && unit <= 0xDFFF; }
+
+// out can be nullptr to only measure
+static size_t NarrowScalar(const byte* start, size_t units, char* out) {
+	size_t length = 0;
+
+	auto put = [&](uint32_t c) {
+		if (out) {
+			out[length] = (char) c;
+		}
+
+		length++;
+	};
+
+	for (size_t i = 0; i < units; i++) {
+		uint32_t codePoint = LoadUnit(start + i * 2);
+
+		if (IsHighSurrogate(codePoint) && i + 1 < units && IsLowSurrogate(LoadUnit(start + i * 2 + 2))) {
+			codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (LoadUnit(start + i * 2 + 2) - 0xDC00);
+
+			i++;
+		}
+
+		if (codePoint < 0x80) {
+			put(codePoint);
+		}
+		else if (codePoint < 0x800) {
+			put(0xC0 | (codePoint >> 6));
+			put(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000) {
+			put(0xE0 | (codePoint >> 12));
+			put(0x80 | ((codePoint >> 6) & 0x3F));
+			put(0x80 | (codePoint & 0x3F));
+		}
+		else {
+			put(0xF0 | (codePoint >> 18));
+			put(0x80 | ((codePoint >> 12) & 0x3F));
+			put(0x80 | ((codePoint >> 6) & 0x3F));
+			put(0x80 | (codePoint & 0x3F));
+		}
+	}
+
+	return length;
+}
+
+// The code point starting at s[i], advances i past it
+static uint32_t DecodeUTF8(std::string_view s, size_t& i) {
+	const unsigned char lead = s[i];
+
+	size_t length = 0;
+	uint32_t codePoint = 0;
+	uint32_t minimum = 0;
+
+	if (lead < 0x80) {
+		i++;
+
+		return lead;
+	}
+	else if (lead >= 0xC2 && lead <= 0xDF) {
+		length = 2;
+		codePoint = lead & 0x1F;
+		minimum = 0x80;
+	}
+	else if (lead >= 0xE0 && lead <= 0xEF) {
+		length = 3;
+		codePoint = lead & 0x0F;
+		minimum = 0x800;
+	}
+	else if (lead >= 0xF0 && lead <= 0xF4) {
+		length = 4;
+		codePoint = lead & 0x07;
+		minimum = 0x10000;
+	}
+
+	if (length != 0 && i + length <= s.size()) {
+		size_t j = 1;
+
+		for (; j < length; j++) {
+			const unsigned char next = s[i + j];
+
+			if ((next & 0xC0) != 0x80) {
+				break;
+			}
+
+			codePoint = (codePoint << 6) | (next & 0x3F);
+		}
+
+		if (j == length && codePoint >= minimum && codePoint <= 0x10FFFF) {
+			i += length;
+
+			return codePoint;
+		}
+	}
+
+	// Not UTF-8, taken as Latin-1 like the old byte by byte writer did
+	i++;
+
+	return lead;
+}
+
+// out can be nullptr to only measure, returns the code units without the terminator
+static size_t WidenScalar(std::string_view s, byte* out) {
+	size_t units = 0;
+
+	for (size_t i = 0; i < s.size();) {
+		uint32_t codePoint = DecodeUTF8(s, i);
+
+		if (codePoint >= 0x10000) {
+			if (out) {
+				StoreUnit(out + units * 2, 0xD800 + ((codePoint - 0x10000) >> 10));
+				StoreUnit(out + units * 2 + 2, 0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+			}
+
+			units += 2;
+		}
+		else {
+			if (out) {
+				StoreUnit(out + units * 2, codePoint);
+			}
+
+			units++;
+		}
+	}
+
+	return units;
+}
+
+static bool IsASCII(std::string_view s) {
+	size_t i = 0;
+
+#if defined(GLEE_UTF16_SSE2)
+	for (; i + 16 <= s.size(); i += 16) {
+		if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (s.data() + i))) != 0) {
+			return false;
+		}
+	}
+#endif
+
+	for (; i < s.size(); i++) {
+		if ((unsigned char) s[i] >= 0x80) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+UTF16::ScanResult UTF16::Scan(const byte* start, const byte* end) {
+	const size_t available = (end - start) / 2;
+
+	size_t i = 0;
+	bool ascii = true;
+
+	// Masks have 2 bits per code unit, from movemask over 16 bit compares
+#if defined(GLEE_UTF16_AVX2)
+	const __m256i zero256 = _mm256_setzero_si256();
+	const __m256i highBits256 = _mm256_set1_epi16((short) 0xFF80);
+
+	for (; i + 16 <= available; i += 16) {
+		const __m256i units = _mm256_loadu_si256((const __m256i *) (start + i * 2));
+
+		const uint32_t terminatorMask = _mm256_movemask_epi8(_mm256_cmpeq_epi16(units, zero256));
+		const uint32_t nonASCIIMask = ~_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(units, highBits256), zero256));
+
+		if (terminatorMask) {
+			const int terminatorBit = std::countr_zero(terminatorMask);
+
+			ascii = ascii && (nonASCIIMask & ((1u << terminatorBit) - 1)) == 0;
+
+			return ScanResult{ i + terminatorBit / 2, ascii, true };
+		}
+
+		ascii = ascii && nonASCIIMask == 0;
+	}
+#endif
+
+#if defined(GLEE_UTF16_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i highBits = _mm_set1_epi16((short) 0xFF80);
+
+	for (; i + 8 <= available; i += 8) {
+		const __m128i units = _mm_loadu_si128((const __m128i *) (start + i * 2));
+
+		const uint32_t terminatorMask = _mm_movemask_epi8(_mm_cmpeq_epi16(units, zero));
+		const uint32_t nonASCIIMask = ~_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, highBits), zero)) & 0xFFFF;
+
+		if (terminatorMask) {
+			const int terminatorBit = std::countr_zero(terminatorMask);
+
+			ascii = ascii && (nonASCIIMask & ((1u << terminatorBit) - 1)) == 0;
+
+			return ScanResult{ i + terminatorBit / 2, ascii, true };
+		}
+
+		ascii = ascii && nonASCIIMask == 0;
+	}
+#endif
+
+	for (; i < available; i++) {
+		const uint16_t unit = LoadUnit(start + i * 2);
+
+		if (unit == 0) {
+			return ScanResult{ i, ascii, true };
+		}
+
+		ascii = ascii && unit < 0x80;
+	}
+
+	return ScanResult{ i, ascii, false };
+}
+
+size_t UTF16::GetNarrowLength(const byte* start, const ScanResult& scan) {
+	return scan.ascii ? scan.units : NarrowScalar(start, scan.units, nullptr);
+}
+
+void UTF16::Narrow(const byte* start, const ScanResult& scan, char* out) {
+	if (!scan.ascii) {
+		NarrowScalar(start, scan.units, out);
+
+		return;
+	}
+
+	size_t i = 0;
+
+	// Every unit is below 0x80, so the saturating packs are exact
+#if defined(GLEE_UTF16_AVX2)
+	for (; i + 32 <= scan.units; i += 32) {
+		const __m256i low = _mm256_loadu_si256((const __m256i *) (start + i * 2));
+		const __m256i high = _mm256_loadu_si256((const __m256i *) (start + i * 2 + 32));
+
+		// The pack works per 128 bit lane, the permute puts the halves back in order
+		const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8);
+
+		_mm256_storeu_si256((__m256i *) (out + i), packed);
+	}
+#endif
+
+#if defined(GLEE_UTF16_SSE2)
+	for (; i + 16 <= scan.units; i += 16) {
+		const __m128i low = _mm_loadu_si128((const __m128i *) (start + i * 2));
+		const __m128i high = _mm_loadu_si128((const __m128i *) (start + i * 2 + 16));
+
+		_mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(low, high));
+	}
+#endif
+
+	for (; i < scan.units; i++) {
+		out[i] = (char) start[i * 2];
+	}
+}
+
+size_t UTF16::GetEncodedSize(std::string_view s) {
+	const size_t units = IsASCII(s) ? s.size() : WidenScalar(s, nullptr);
+
+	return (units + 1) * 2;
+}
+
+void UTF16::Widen(std::string_view s, byte* out) {
+	if (!IsASCII(s)) {
+		StoreUnit(out + WidenScalar(s, out) * 2, 0);
+
+		return;
+	}
+
+	size_t i = 0;
+
+#if defined(GLEE_UTF16_AVX2)
+	for (; i + 16 <= s.size(); i += 16) {
+		const __m128i chars = _mm_loadu_si128((const __m128i *) (s.data() + i));
+
+		_mm256_storeu_si256((__m256i *) (out + i * 2), _mm256_cvtepu8_epi16(chars));
+	}
+#elif defined(GLEE_UTF16_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 16 <= s.size(); i += 16) {
+		const __m128i chars = _mm_loadu_si128((const __m128i *) (s.data() + i));
+
+		_mm_storeu_si128((__m128i *) (out + i * 2), _mm_unpacklo_epi8(chars, zero));
+		_mm_storeu_si128((__m128i *) (out + i * 2 + 16), _mm_unpackhi_epi8(chars, zero));
+	}
+#endif
+
+	for (; i < s.size(); i++) {
+		StoreUnit(out + i * 2, (unsigned char) s[i]);
+	}
+
+	StoreUnit(out + s.size() * 2, 0);
+}
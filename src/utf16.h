@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+typedef unsigned char byte;
+
+// UTF-16LE <-> narrow strings, vectorized for the all ASCII names the game uses
+// Anything else is narrowed to UTF-8, lone surrogates included (WTF-8), so it round trips exactly
+namespace UTF16 {
+	struct ScanResult {
+		// Code units before the terminator
+		size_t units;
+		bool ascii;
+		bool terminated;
+	};
+
+	// Looks for the terminator between start and end
+	ScanResult Scan(const byte* start, const byte* end);
+
+	// Length of the narrowed string
+	size_t GetNarrowLength(const byte* start, const ScanResult& scan);
+	// out has to fit GetNarrowLength chars, it isn't null terminated
+	void Narrow(const byte* start, const ScanResult& scan, char* out);
+
+	// Bytes s takes as UTF-16, terminator included
+	size_t GetEncodedSize(std::string_view s);
+	// out has to fit GetEncodedSize bytes
+	// Bytes that aren't valid UTF-8 are taken as Latin-1
+	void Widen(std::string_view s, byte* out);
+}
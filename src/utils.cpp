@@ -4,6 +4,17 @@ std::string StringUtils::Trim(const std::string& s) {
 	return s.substr(s.find_first_not_of(' '), s.find_last_not_of(' '));
 }
 
+uint64_t StringUtils::Hash(std::string_view s) {
+	uint64_t hash = 0xCBF29CE484222325;
+
+	for (char c : s) {
+		hash ^= (unsigned char) c;
+		hash *= 0x100000001B3;
+	}
+
+	return hash;
+}
+
 std::filesystem::path PathUtils::ChangeSlashes(const std::filesystem::path& p) {
 	std::string s = p.string();
 
@@ -18,4 +29,22 @@ std::filesystem::path PathUtils::ChangeSlashes(const std::filesystem::path& p) {
 
 std::filesystem::path PathUtils::StemWindows(const std::filesystem::path& p) {
 	return PathUtils::ChangeSlashes(p).stem();
-}
\ No newline at end of file
+}
+
+std::string_view PathUtils::StemWindowsView(std::string_view p) {
+	size_t separator = p.find_last_of("\\/");
+	std::string_view fileName = separator == std::string_view::npos ? p : p.substr(separator + 1);
+
+	if (fileName == "." || fileName == "..") {
+		return fileName;
+	}
+
+	size_t extension = fileName.find_last_of('.');
+
+	// A leading dot isn't an extension
+	if (extension == std::string_view::npos || extension == 0) {
+		return fileName;
+	}
+
+	return fileName.substr(0, extension);
+}
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <filesystem>
 
 namespace StringUtils {
 	std::string Trim(const std::string& s);
 
+	// 64 bit FNV-1a
+	uint64_t Hash(std::string_view s);
+
 	template<typename CharType>
 	requires (
 		std::same_as<CharType, char>
@@ -27,4 +32,6 @@ namespace StringUtils {
 namespace PathUtils {
 	std::filesystem::path ChangeSlashes(const std::filesystem::path& p);
 	std::filesystem::path StemWindows(const std::filesystem::path& p);
+	// Same as above, as a view into the path, no allocations
+	std::string_view StemWindowsView(std::string_view p);
 }
\ No newline at end of file